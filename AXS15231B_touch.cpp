@@ -1,4 +1,5 @@
 #include "AXS15231B_touch.h"
+#include <esp_timer.h>
 
 
 
@@ -21,6 +22,12 @@ void AXS15231B_Touch::isrTouched() {
     // This ISR gets executed if the display reports a touch interrupt
     if (instance) {
         instance->touch_int = true;
+        instance->irq_us = (uint32_t)esp_timer_get_time();
+        if (instance->notify_task) {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(instance->notify_task, &woken);
+            if (woken) portYIELD_FROM_ISR();
+        }
     }
 }
 
@@ -20,9 +20,15 @@ public:
     void readData(uint16_t *, uint16_t *);
     void enOffsetCorrection(bool);
     void setOffsets(uint16_t, uint16_t, uint16_t, uint16_t, uint16_t, uint16_t);
+    // Wake this task (task notification) from the interrupt
+    void setNotifyTask(TaskHandle_t task) { notify_task = task; }
+    // micros() when the last interrupt fired
+    uint32_t lastInterruptUs() const { return irq_us; }
 
 protected:
     volatile bool touch_int = false;
+    volatile uint32_t irq_us = 0;
+    TaskHandle_t notify_task = nullptr;
 
 private:
     bool en_offset_correction = false;
@@ -0,0 +1,589 @@
+#include "AdDecoder.h"
+#include "MemoryManager.h"
+#include "PngDecoder.h"
+#include <SD.h>
+#include <TJpg_Decoder.h>
+
+uint16_t *AdDecoder::_target = nullptr;
+int AdDecoder::_targetW = AD_WIDTH;
+int AdDecoder::_targetH = AD_HEIGHT;
+
+AdDecoder::AdDecoder() {
+  memset(_cache, 0, sizeof(_cache));
+}
+
+bool AdDecoder::begin() {
+  // Frames are allocated on first decode, not at boot
+  memoryManager.setBudget(MEM_ADS, _budget + AD_CACHE_MAX_FRAMES * 64); // Heap block overhead
+  TJpgDec.setCallback(jpegOutput); // Scale is chosen per image in decodeJpeg()
+
+  _lock = xSemaphoreCreateMutex();
+  _jobs = xQueueCreate(1, sizeof(Job));
+  _thumbJobs = xQueueCreate(AD_THUMB_QUEUE, sizeof(ThumbJob));
+  return xTaskCreatePinnedToCore(taskEntry, "ad_decode", AD_DECODER_STACK, this, 1, &_task,
+                                 AD_DECODER_CORE) == pdPASS;
+}
+
+size_t AdDecoder::residentBytes() const {
+  size_t frames = 0;
+  for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+    if (_cache[i].frame) frames++;
+  }
+  return frames * AD_FRAME_BYTES;
+}
+
+int AdDecoder::findLocked(const char *path, uint32_t stamp) {
+  for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+    CacheEntry &e = _cache[i];
+    if (e.frame && e.valid && e.stamp == stamp && strcmp(e.path, path) == 0) return i;
+  }
+  return -1;
+}
+
+// Picks the slot to decode into: a new frame while under budget, otherwise
+// the least recently used one that is neither on screen nor about to be
+int AdDecoder::acquireFrameLocked() {
+  // Frames holding nothing reusable (old video frames) first
+  for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+    CacheEntry &e = _cache[i];
+    if (e.frame && !e.valid && e.frame != _front && e.frame != _readyFrame) return i;
+  }
+
+  if (residentBytes() + AD_FRAME_BYTES <= _budget) {
+    for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+      if (_cache[i].frame) continue;
+      // Never from internal SRAM: a frame would exhaust it
+      _cache[i].frame = (uint16_t *)memoryManager.alloc(MEM_ADS, AD_FRAME_BYTES, false);
+      if (!_cache[i].frame) break; // PSRAM exhausted: fall back to eviction
+      _cache[i].valid = false;
+      return i;
+    }
+  }
+
+  int victim = -1;
+  for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+    CacheEntry &e = _cache[i];
+    if (!e.frame || e.frame == _front || e.frame == _readyFrame) continue;
+    if (victim < 0 || e.lastUse < _cache[victim].lastUse) victim = i;
+  }
+  if (victim >= 0) _cache[victim].valid = false;
+  return victim;
+}
+
+bool AdDecoder::isVideoPath(const char *path) {
+  const char *dot = strrchr(path, '.');
+  return dot && (strcasecmp(dot, ".mjpeg") == 0 || strcasecmp(dot, ".mjpg") == 0 ||
+                 strcasecmp(dot, ".avi") == 0);
+}
+
+bool AdDecoder::request(const char *path, uint32_t stamp, int tag) {
+  if (!_jobs || _busy) return false;
+
+  if (isVideoPath(path)) {
+    // Never cached: the task streams it frame by frame
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    clearReadyLocked();
+    _requestTag = tag;
+    xSemaphoreGive(_lock);
+    _stopVideo = false;
+    _videoPlaying = true; // Until the task gives up on it
+    Job job;
+    strlcpy(job.path, path, sizeof(job.path));
+    job.stamp = stamp;
+    job.tag = tag;
+    _busy = true;
+    xQueueOverwrite(_jobs, &job);
+    return true;
+  }
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _requestTag = tag;
+  int idx = findLocked(path, stamp);
+  if (idx >= 0) {
+    _cache[idx].lastUse = ++_clock;
+    _readyFrame = _cache[idx].frame;
+    _readyTag = tag;
+    _ready = true;
+    _stats.hits++;
+    xSemaphoreGive(_lock);
+    return true;
+  }
+  _stats.misses++;
+  clearReadyLocked();
+  xSemaphoreGive(_lock);
+
+  Job job;
+  strlcpy(job.path, path, sizeof(job.path));
+  job.stamp = stamp;
+  job.tag = tag;
+  _busy = true;
+  xQueueOverwrite(_jobs, &job);
+  return true;
+}
+
+uint16_t *AdDecoder::swap() {
+  if (!_ready) return _front;
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_ready) { // cancel() may have run since the check above
+    _front = _readyFrame;
+    clearReadyLocked();
+  }
+  xSemaphoreGive(_lock);
+  return _front;
+}
+
+void AdDecoder::cancel() {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _stopVideo = true;
+  _requestTag = -1;
+  clearReadyLocked();
+  xSemaphoreGive(_lock);
+}
+
+void AdDecoder::clearReadyLocked() {
+  _ready = false;
+  _readyFrame = nullptr;
+  _readyTag = -1;
+}
+
+void AdDecoder::releaseMemory(bool keepFront) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (int i = 0; i < AD_CACHE_MAX_FRAMES; i++) {
+    CacheEntry &e = _cache[i];
+    if (!e.frame || e.frame == _decodeTarget) continue;
+    if (keepFront && e.frame == _front) continue;
+    if (e.frame == _front) _front = nullptr;
+    if (e.frame == _readyFrame) clearReadyLocked();
+    memoryManager.free(MEM_ADS, e.frame);
+    e.frame = nullptr;
+    e.valid = false;
+  }
+  xSemaphoreGive(_lock);
+}
+
+void AdDecoder::taskEntry(void *arg) {
+  AdDecoder *self = (AdDecoder *)arg;
+  Job job;
+  ThumbJob thumb;
+  for (;;) {
+    if (xQueueReceive(self->_jobs, &job, pdMS_TO_TICKS(100)) == pdTRUE) {
+      if (isVideoPath(job.path)) {
+        self->playVideo(job);
+      } else {
+        self->decode(job);
+      }
+    }
+    // Thumbnails only while no ad is waiting to be decoded
+    if (!self->_busy && xQueueReceive(self->_thumbJobs, &thumb, 0) == pdTRUE) {
+      self->makeThumbnail(thumb);
+    }
+  }
+}
+
+bool AdDecoder::requestThumbnail(const char *src, const char *dst) {
+  if (!_thumbJobs || isVideoPath(src)) return false;
+  ThumbJob job;
+  strlcpy(job.src, src, sizeof(job.src));
+  strlcpy(job.dst, dst, sizeof(job.dst));
+  return xQueueSend(_thumbJobs, &job, 0) == pdTRUE;
+}
+
+// JPEGs are decoded at 1/8 straight into a small buffer; PNG and raw ads
+// go through a temporary full frame. Either way the result is sampled down
+// to fit AD_THUMB_MAX_W x AD_THUMB_MAX_H and written as a 16-bit BMP.
+void AdDecoder::makeThumbnail(const ThumbJob &job) {
+  unsigned long t0 = millis();
+  size_t len = strlen(job.src);
+  bool jpeg = (len > 4 && strcasecmp(job.src + len - 4, ".jpg") == 0) ||
+              (len > 5 && strcasecmp(job.src + len - 5, ".jpeg") == 0);
+
+  int sw = AD_WIDTH, sh = AD_HEIGHT;
+  uint16_t w = 0, h = 0;
+  uint8_t scale = 8;
+  if (jpeg) {
+    if (TJpgDec.getSdJpgSize(&w, &h, job.src) != JDR_OK || w == 0 || h == 0) return;
+    // Coarsest decoder scale that still covers the thumbnail (a 480x320
+    // ad needs 1/4); writeBmp() shrinks the rest of the way
+    while (scale > 1 && (w + scale - 1) / scale < AD_THUMB_MAX_W && (h + scale - 1) / scale < AD_THUMB_MAX_H) {
+      scale /= 2;
+    }
+    sw = min((w + scale - 1) / scale, AD_WIDTH);
+    sh = min((h + scale - 1) / scale, AD_HEIGHT);
+  }
+  uint16_t *src = (uint16_t *)memoryManager.alloc(MEM_DECODE, sw * sh * sizeof(uint16_t), false);
+  if (!src) return;
+  memset(src, 0, sw * sh * sizeof(uint16_t));
+
+  bool ok = true;
+  if (jpeg) {
+    TJpgDec.setJpgScale(scale);
+    _target = src;
+    _targetW = sw;
+    _targetH = sh;
+    TJpgDec.drawSdJpg(0, 0, job.src);
+    _target = nullptr;
+    _targetW = AD_WIDTH;
+    _targetH = AD_HEIGHT;
+  } else if (len > 4 && strcasecmp(job.src + len - 4, ".png") == 0) {
+    File file = SD.open(job.src, FILE_READ);
+    ok = file && PngDecoder::decode(file, src, sw, sh);
+    if (file) file.close();
+  } else if (len > 4 && strcasecmp(job.src + len - 4, AD_RAW_EXT) == 0) {
+    ok = loadRaw(job.src, src);
+  } else {
+    ok = false;
+  }
+
+  if (ok) ok = writeBmp(job.dst, src, sw, sh);
+  memoryManager.free(MEM_DECODE, src);
+  Serial.printf("ADS: Thumbnail %s %s in %lu ms\n", job.dst, ok ? "written" : "failed", millis() - t0);
+}
+
+// Nearest-neighbour sample of src into a top-down RGB565 BMP (BI_BITFIELDS)
+bool AdDecoder::writeBmp(const char *path, const uint16_t *src, int sw, int sh) {
+  int f = max((sw + AD_THUMB_MAX_W - 1) / AD_THUMB_MAX_W, (sh + AD_THUMB_MAX_H - 1) / AD_THUMB_MAX_H);
+  if (f < 1) f = 1;
+  int tw = sw / f, th = sh / f;
+  if (tw == 0 || th == 0) return false;
+  uint32_t stride = (tw * 2 + 3) & ~3;
+  uint32_t dataSize = stride * th;
+
+  uint8_t hdr[66] = {'B', 'M'};
+  auto put32 = [&](int off, uint32_t v) { memcpy(hdr + off, &v, 4); };
+  put32(2, sizeof(hdr) + dataSize);
+  put32(10, sizeof(hdr));         // Pixel data offset
+  put32(14, 40);                  // BITMAPINFOHEADER
+  put32(18, tw);
+  put32(22, (uint32_t)(-th));     // Negative height: top-down rows
+  hdr[26] = 1;                    // Planes
+  hdr[28] = 16;                   // Bits per pixel
+  put32(30, 3);                   // BI_BITFIELDS
+  put32(34, dataSize);
+  put32(54, 0xF800);              // Red, green, blue masks
+  put32(58, 0x07E0);
+  put32(62, 0x001F);
+
+  String tmp = String(path) + ".tmp";
+  File file = SD.open(tmp, FILE_WRITE);
+  if (!file) return false;
+  bool ok = file.write(hdr, sizeof(hdr)) == sizeof(hdr);
+  uint8_t row[AD_THUMB_MAX_W * 2 + 4] = {0};
+  for (int y = 0; ok && y < th; y++) {
+    const uint16_t *line = src + (y * f) * sw;
+    for (int x = 0; x < tw; x++) {
+      uint16_t px = line[x * f];
+      row[x * 2] = px & 0xFF;
+      row[x * 2 + 1] = px >> 8;
+    }
+    ok = file.write(row, stride) == stride;
+  }
+  file.close();
+  if (!ok) {
+    SD.remove(tmp);
+    return false;
+  }
+  SD.remove(path);
+  return SD.rename(tmp, path);
+}
+
+void AdDecoder::decode(const Job &job) {
+  unsigned long t0 = millis();
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int slot = acquireFrameLocked();
+  _decodeTarget = slot >= 0 ? _cache[slot].frame : nullptr;
+  xSemaphoreGive(_lock);
+
+  if (slot < 0) {
+    Serial.println("ADS: No frame available for decode");
+    _busy = false;
+    return;
+  }
+
+  size_t len = strlen(job.path);
+  bool raw = len > 4 && strcasecmp(job.path + len - 4, AD_RAW_EXT) == 0;
+  bool png = len > 4 && strcasecmp(job.path + len - 4, ".png") == 0;
+  if (png) {
+    // Streamed row by row, never the whole file in memory
+    memset(_decodeTarget, 0, AD_FRAME_BYTES);
+    File file = SD.open(job.path, FILE_READ);
+    if (!file || !PngDecoder::decode(file, _decodeTarget, AD_WIDTH, AD_HEIGHT)) {
+      Serial.printf("ADS: Cannot decode PNG %s\n", job.path);
+    }
+    if (file) file.close();
+  } else if (raw) {
+    // Pre-converted: sequential SD reads straight into the frame
+    if (!loadRaw(job.path, _decodeTarget)) {
+      Serial.printf("ADS: Invalid raw ad %s\n", job.path);
+      memset(_decodeTarget, 0, AD_FRAME_BYTES);
+    }
+  } else {
+    decodeJpeg(job.path, _decodeTarget);
+  }
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  CacheEntry &e = _cache[slot];
+  strlcpy(e.path, job.path, sizeof(e.path));
+  e.stamp = job.stamp;
+  e.valid = true;
+  e.lastUse = ++_clock;
+  _decodeTarget = nullptr;
+  if (job.tag == _requestTag) { // Otherwise superseded or cancelled: cache only
+    _readyFrame = e.frame;
+    _readyTag = job.tag;
+    _ready = true;
+  }
+  xSemaphoreGive(_lock);
+
+  uint32_t elapsed = millis() - t0;
+  _stats.decodes++;
+  _stats.lastDecodeMs = elapsed;
+  _stats.totalDecodeMs += elapsed;
+  if (elapsed > _stats.maxDecodeMs) _stats.maxDecodeMs = elapsed;
+  if (png) {
+    _stats.pngDecodes++;
+    _stats.pngTotalMs += elapsed;
+  } else if (raw) {
+    _stats.rawLoads++;
+    _stats.rawTotalMs += elapsed;
+  } else {
+    _stats.jpegDecodes++;
+    _stats.jpegTotalMs += elapsed;
+  }
+  _busy = false;
+}
+
+// Hands a freshly decoded video frame to the display. Waits (without
+// holding the lock) until the previous one has been swapped in.
+bool AdDecoder::publishFrame(int slot, int tag) {
+  while (_ready && !_stopVideo) vTaskDelay(pdMS_TO_TICKS(2));
+  if (_stopVideo) return false;
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  CacheEntry &e = _cache[slot];
+  e.valid = false; // Video frames are never cache hits
+  e.lastUse = ++_clock;
+  _decodeTarget = nullptr;
+  bool current = !_stopVideo && tag == _requestTag; // cancel() may have run while decoding
+  if (current) {
+    _readyFrame = e.frame;
+    _readyTag = tag;
+    _ready = true;
+  }
+  xSemaphoreGive(_lock);
+  return current;
+}
+
+// Streams an MJPEG file (or the MJPEG chunks of an AVI): each frame is the
+// bytes between SOI (FFD8) and EOI (FFD9), read sequentially into a PSRAM
+// buffer and decoded from memory into a back frame while the display shows
+// the front one. Frames that are already a full period late are skipped
+// (and counted) instead of decoded, so playback keeps real-time pace.
+void AdDecoder::playVideo(const Job &job) {
+  File file = SD.open(job.path, FILE_READ);
+  uint8_t *buf = (uint8_t *)memoryManager.alloc(MEM_DECODE, AD_VIDEO_READ_BUFFER, false);
+  if (!file || !buf) {
+    Serial.printf("ADS: Cannot play video %s\n", job.path);
+    if (file) file.close();
+    memoryManager.free(MEM_DECODE, buf);
+    _videoPlaying = false;
+    _busy = false;
+    return;
+  }
+
+  const uint32_t interval = 1000 / AD_VIDEO_FPS;
+  uint32_t shown = 0, dropped = 0, decodeMs = 0;
+  size_t len = 0, pos = 0;
+  bool eof = false;
+  int32_t x = 0, y = 0;
+  uint16_t lastW = 0, lastH = 0;
+  unsigned long start = millis();
+
+  for (uint32_t index = 0; !_stopVideo; index++) {
+    // Find the next SOI..EOI, refilling the buffer as needed
+    size_t soi = SIZE_MAX, eoi = SIZE_MAX;
+    for (;;) {
+      for (size_t i = pos; soi == SIZE_MAX && i + 1 < len; i++) {
+        if (buf[i] == 0xFF && buf[i + 1] == 0xD8) soi = i;
+      }
+      if (soi != SIZE_MAX) {
+        for (size_t i = soi + 2; i + 1 < len; i++) {
+          if (buf[i] == 0xFF && buf[i + 1] == 0xD9) {
+            eoi = i + 2;
+            break;
+          }
+        }
+      }
+      if (eoi != SIZE_MAX || eof) break;
+
+      // Keep the partial frame, drop what was consumed, read more
+      size_t keep = soi != SIZE_MAX ? soi : (len > 0 ? len - 1 : 0);
+      memmove(buf, buf + keep, len - keep);
+      len -= keep;
+      pos = 0;
+      if (soi != SIZE_MAX) soi = 0;
+      if (len == AD_VIDEO_READ_BUFFER) {
+        // Frame larger than the buffer: skip it
+        dropped++;
+        len = 0;
+        soi = SIZE_MAX;
+      }
+      int n = file.read(buf + len, AD_VIDEO_READ_BUFFER - len);
+      if (n <= 0) eof = true;
+      else len += n;
+    }
+    if (eoi == SIZE_MAX) break; // End of file
+    pos = eoi;
+
+    unsigned long due = start + index * interval;
+    if ((long)(millis() - (due + interval)) > 0) {
+      dropped++;
+      continue;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    int slot = acquireFrameLocked();
+    _decodeTarget = slot >= 0 ? _cache[slot].frame : nullptr;
+    xSemaphoreGive(_lock);
+    if (slot < 0) break;
+
+    unsigned long t0 = millis();
+    uint16_t w = 0, h = 0;
+    if (TJpgDec.getJpgSize(&w, &h, buf + soi, eoi - soi) == JDR_OK && (w != lastW || h != lastH)) {
+      TJpgDec.setJpgScale(chooseScale(w, h, x, y));
+      lastW = w;
+      lastH = h;
+    }
+    if (x > 0 || y > 0) memset(_decodeTarget, 0, AD_FRAME_BYTES); // Letterbox
+    _target = _decodeTarget;
+    TJpgDec.drawJpg(x, y, buf + soi, eoi - soi);
+    _target = nullptr;
+    decodeMs += millis() - t0;
+
+    if (!publishFrame(slot, job.tag)) break;
+    shown++;
+
+    long wait = (long)(due + interval - millis());
+    if (wait > 0) vTaskDelay(pdMS_TO_TICKS(wait));
+  }
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  _decodeTarget = nullptr;
+  xSemaphoreGive(_lock);
+  file.close();
+  memoryManager.free(MEM_DECODE, buf);
+
+  uint32_t elapsed = millis() - start;
+  Serial.printf("ADS: Video %s: %u frames shown, %u dropped, %.1f fps, avg decode %u ms%s\n", job.path,
+                shown, dropped, elapsed ? shown * 1000.0f / elapsed : 0.0f, shown ? decodeMs / shown : 0,
+                _stopVideo ? " (stopped)" : "");
+  _stats.videoFrames += shown;
+  _stats.videoDropped += dropped;
+  _stats.videoTotalMs += decodeMs;
+  _videoPlaying = false;
+  _busy = false;
+}
+
+bool AdDecoder::loadRaw(const char *path, uint16_t *frame) {
+  File file = SD.open(path, FILE_READ);
+  if (!file) return false;
+
+  AdRawHeader hdr;
+  bool ok = file.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+            memcmp(hdr.magic, AD_RAW_MAGIC, 4) == 0 && hdr.version == AD_RAW_VERSION &&
+            hdr.width == AD_WIDTH && hdr.height == AD_HEIGHT;
+  if (!ok) {
+    file.close();
+    return false;
+  }
+
+  if (!(hdr.flags & AD_RAW_FLAG_RLE)) {
+    ok = hdr.payloadBytes == AD_FRAME_BYTES && file.read((uint8_t *)frame, AD_FRAME_BYTES) == AD_FRAME_BYTES;
+    file.close();
+    return ok;
+  }
+
+  // RLE: stream through a small buffer, never writing past the frame
+  uint8_t buf[2048];
+  size_t bufLen = 0, bufPos = 0;
+  auto readU16 = [&](uint16_t &v) -> bool {
+    if (bufLen - bufPos < 2) {
+      memmove(buf, buf + bufPos, bufLen - bufPos);
+      bufLen -= bufPos;
+      bufPos = 0;
+      bufLen += file.read(buf + bufLen, sizeof(buf) - bufLen);
+      if (bufLen < 2) return false;
+    }
+    v = buf[bufPos] | (buf[bufPos + 1] << 8);
+    bufPos += 2;
+    return true;
+  };
+
+  const size_t total = AD_WIDTH * AD_HEIGHT;
+  size_t out = 0;
+  uint16_t ctrl, px;
+  while (out < total && readU16(ctrl)) {
+    size_t n = (ctrl & 0x7FFF) + 1;
+    if (out + n > total) break;
+    if (ctrl & 0x8000) {
+      if (!readU16(px)) break;
+      for (size_t i = 0; i < n; i++) frame[out++] = px;
+    } else {
+      size_t i = 0;
+      for (; i < n && readU16(px); i++) frame[out++] = px;
+      if (i < n) break;
+    }
+  }
+  file.close();
+  return out == total;
+}
+
+// Smallest 1/2/4/8 scale that fits the screen (TJpgDec skips the discarded
+// detail in the IDCT), plus the offset that centers the result. Anything
+// still larger than the screen at 1/8 is center-cropped.
+uint8_t AdDecoder::chooseScale(uint16_t w, uint16_t h, int32_t &x, int32_t &y) {
+  uint8_t scale = 1;
+  while (scale < 8 && (w / scale > AD_WIDTH || h / scale > AD_HEIGHT)) scale *= 2;
+  x = (AD_WIDTH - (int32_t)(w / scale)) / 2;
+  y = (AD_HEIGHT - (int32_t)(h / scale)) / 2;
+  return scale;
+}
+
+void AdDecoder::decodeJpeg(const char *path, uint16_t *frame) {
+  memset(frame, 0, AD_FRAME_BYTES);
+
+  uint16_t w = 0, h = 0;
+  if (TJpgDec.getSdJpgSize(&w, &h, path) != JDR_OK || w == 0 || h == 0) {
+    Serial.printf("ADS: Unreadable JPEG header %s\n", path);
+    return;
+  }
+  int32_t x, y;
+  uint8_t scale = chooseScale(w, h, x, y);
+  if (scale > 1) Serial.printf("ADS: %s is %ux%u, decoding at 1/%u\n", path, w, h, scale);
+
+  TJpgDec.setJpgScale(scale);
+  _target = frame;
+  TJpgDec.drawSdJpg(x, y, path);
+  _target = nullptr;
+}
+
+bool AdDecoder::jpegOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap) {
+  if (_target == nullptr) return false;
+
+  // Clip the MCU block once, then copy whole rows
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < 0 ? 0 : y;
+  int x1 = x + w > _targetW ? _targetW : x + w;
+  int y1 = y + h > _targetH ? _targetH : y + h;
+  if (x0 >= x1 || y0 >= y1) return true; // Off screen, keep decoding
+
+  size_t rowBytes = (x1 - x0) * sizeof(uint16_t);
+  const uint16_t *src = bitmap + (y0 - y) * w + (x0 - x);
+  uint16_t *dst = _target + y0 * _targetW + x0;
+  for (int row = y0; row < y1; row++) {
+    memcpy(dst, src, rowBytes);
+    src += w;
+    dst += _targetW;
+  }
+  return true;
+}
@@ -0,0 +1,163 @@
+#ifndef ADDECODER_H
+#define ADDECODER_H
+
+#include <Arduino.h>
+#include "AdManifest.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#define AD_WIDTH 480
+#define AD_HEIGHT 320
+#define AD_FRAME_BYTES (AD_WIDTH * AD_HEIGHT * sizeof(uint16_t))
+#define AD_DECODER_CORE 0 // Arduino loop()/LVGL run on core 1
+#define AD_DECODER_STACK 6144
+#define AD_PATH_MAX 96
+
+// Decoded frames kept in PSRAM (~2.4 MB of the 8 MB by default)
+#define AD_CACHE_BUDGET_DEFAULT (8 * AD_FRAME_BYTES)
+#define AD_CACHE_MAX_FRAMES 16
+
+// Pre-converted ads (*.565, written by convert_ads.py), little-endian:
+//   "R565" | u16 width | u16 height | u8 version | u8 flags | u16 reserved
+//   | u32 payload bytes, then the pixels, row-major RGB565 in native order.
+// With AD_RAW_FLAG_RLE the payload is packets of a u16 control word:
+// bit 15 set -> (ctrl & 0x7FFF) + 1 copies of the next pixel, otherwise
+// ctrl + 1 literal pixels follow. Only 480x320 files are accepted.
+#define AD_RAW_MAGIC "R565"
+#define AD_RAW_VERSION 1
+#define AD_RAW_FLAG_RLE 0x01
+#define AD_RAW_EXT ".565"
+
+// Video ads (*.mjpeg, *.mjpg, *.avi with MJPEG frames) are played by the
+// decode task frame by frame into the same front/back frames
+//   ffmpeg -i in.mp4 -vf scale=480:320 -r 18 -q:v 6 -f mjpeg ad.mjpeg
+#define AD_VIDEO_FPS 18
+#define AD_VIDEO_READ_BUFFER (128 * 1024) // PSRAM, must hold one whole frame
+
+// Admin thumbnails (size limits in AdManifest.h), generated by the decode
+// task when it is idle
+#define AD_THUMB_QUEUE 8
+
+struct __attribute__((packed)) AdRawHeader {
+  char magic[4];
+  uint16_t width;
+  uint16_t height;
+  uint8_t version;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t payloadBytes;
+};
+
+// Background ad decoder with an LRU cache of decoded RGB565 frames.
+// A task pinned to the other core decodes the next ad from SD into a free
+// (or least recently used) cache frame while LVGL keeps showing the front
+// one; a cached ad is ready immediately with no SD I/O and no decode.
+// The frame on screen and the one waiting to be swapped in are never evicted.
+class AdDecoder {
+public:
+  struct Stats {
+    uint32_t decodes = 0;
+    uint32_t lastDecodeMs = 0;
+    uint32_t maxDecodeMs = 0;
+    uint32_t totalDecodeMs = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    // Per format, to compare raw .565 loads against JPEG decodes
+    uint32_t jpegDecodes = 0;
+    uint32_t jpegTotalMs = 0;
+    uint32_t rawLoads = 0;
+    uint32_t rawTotalMs = 0;
+    uint32_t pngDecodes = 0;
+    uint32_t pngTotalMs = 0;
+    uint32_t videoFrames = 0;   // Decoded and handed to the display
+    uint32_t videoDropped = 0;  // Skipped to keep up with AD_VIDEO_FPS
+    uint32_t videoTotalMs = 0;  // Decode time of the shown frames
+  };
+
+  AdDecoder();
+  bool begin();
+
+  // Prepares an ad for swap(): from cache if (path, stamp) is resident,
+  // otherwise queued for decode. tag identifies the job in readyTag();
+  // only the latest request's frames are published. For a video the task
+  // keeps publishing frames until it ends or cancel() is called; poll
+  // isReady() and swap() each one.
+  bool request(const char *path, uint32_t stamp, int tag);
+  // Stops a playing video and drops the prepared frame. A decode in flight
+  // still lands in the cache but is not published.
+  void cancel();
+  bool isVideoPlaying() const { return _videoPlaying; }
+  static bool isVideoPath(const char *path);
+
+  // Queues a thumbnail of src (image ads only) to be written to dst
+  bool requestThumbnail(const char *src, const char *dst);
+  bool isBusy() const { return _busy; }
+  bool isReady() const { return _ready; }
+  int readyTag() const { return _readyTag; }
+
+  // Makes the prepared frame the front one; returns the new front
+  uint16_t *swap();
+  uint16_t *front() const { return _front; }
+
+  // Frees every cached frame (including the front one unless keepFront)
+  void releaseMemory(bool keepFront);
+  size_t residentBytes() const;
+  const Stats &getStats() const { return _stats; }
+
+private:
+  struct Job {
+    char path[AD_PATH_MAX];
+    uint32_t stamp;
+    int tag;
+  };
+  struct ThumbJob {
+    char src[AD_PATH_MAX];
+    char dst[AD_PATH_MAX + 16];
+  };
+  struct CacheEntry {
+    char path[AD_PATH_MAX];
+    uint32_t stamp;    // mtime ^ size: a re-uploaded file misses
+    uint16_t *frame;   // nullptr: slot unused
+    uint32_t lastUse;
+    bool valid;        // frame holds this path's pixels
+  };
+
+  CacheEntry _cache[AD_CACHE_MAX_FRAMES];
+  size_t _budget = AD_CACHE_BUDGET_DEFAULT;
+  uint32_t _clock = 0;
+  SemaphoreHandle_t _lock = nullptr; // Guards _cache and the frame pointers
+
+  uint16_t *_front = nullptr;
+  uint16_t *_readyFrame = nullptr;
+  uint16_t *_decodeTarget = nullptr;
+  QueueHandle_t _jobs = nullptr;
+  QueueHandle_t _thumbJobs = nullptr;
+  TaskHandle_t _task = nullptr;
+  volatile bool _busy = false;
+  volatile bool _ready = false;
+  volatile int _readyTag = -1;
+  volatile int _requestTag = -1; // Tag of the latest request(), -1 after cancel()
+  volatile bool _stopVideo = false;
+  volatile bool _videoPlaying = false;
+  Stats _stats;
+
+  int findLocked(const char *path, uint32_t stamp);
+  int acquireFrameLocked();
+  void clearReadyLocked();
+  void decode(const Job &job);
+  bool loadRaw(const char *path, uint16_t *frame);
+  void decodeJpeg(const char *path, uint16_t *frame);
+  void playVideo(const Job &job);
+  bool publishFrame(int slot, int tag);
+  void makeThumbnail(const ThumbJob &job);
+  static bool writeBmp(const char *path, const uint16_t *src, int sw, int sh);
+  static uint8_t chooseScale(uint16_t w, uint16_t h, int32_t &x, int32_t &y);
+  static void taskEntry(void *arg);
+  static bool jpegOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap);
+  static uint16_t *_target; // Buffer the TJpgDec callback writes to
+  static int _targetW, _targetH;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "AdManifest.h"
+
+AdManifest::AdManifest() {}
+
+String AdManifest::baseName(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return String(slash ? slash + 1 : path);
+}
+
+// Reads width/height from the JPEG SOFn, PNG IHDR or raw R565 header (a few
+// hundred bytes at most, never the image data)
+bool AdManifest::readImageSize(File &file, uint16_t &w, uint16_t &h) {
+  uint8_t hdr[24];
+  file.seek(0);
+  if (file.read(hdr, 2) != 2) return false;
+
+  if (hdr[0] == 0x89 && hdr[1] == 'P') {
+    if (file.read(hdr + 2, 22) != 22) return false;
+    w = (hdr[18] << 8) | hdr[19]; // IHDR width/height are 32-bit BE
+    h = (hdr[22] << 8) | hdr[23];
+    return true;
+  }
+
+  if (hdr[0] == 'R' && hdr[1] == '5') {
+    if (file.read(hdr + 2, 6) != 6 || memcmp(hdr, "R565", 4) != 0) return false;
+    w = hdr[4] | (hdr[5] << 8); // Little-endian, see AdRawHeader
+    h = hdr[6] | (hdr[7] << 8);
+    return true;
+  }
+
+  if (hdr[0] != 0xFF || hdr[1] != 0xD8) return false;
+  while (file.available()) {
+    if (file.read(hdr, 4) != 4 || hdr[0] != 0xFF) return false;
+    uint8_t marker = hdr[1];
+    uint16_t len = (hdr[2] << 8) | hdr[3];
+    bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+    if (sof) {
+      if (file.read(hdr, 5) != 5) return false;
+      h = (hdr[1] << 8) | hdr[2];
+      w = (hdr[3] << 8) | hdr[4];
+      return true;
+    }
+    if (marker == 0xD9 || marker == 0xDA || len < 2) return false;
+    file.seek(file.position() + len - 2);
+  }
+  return false;
+}
+
+void AdManifest::statEntry(AdEntry &e, File &file) {
+  e.size = file.size();
+  e.mtime = (uint32_t)file.getLastWrite();
+  e.width = 0;
+  e.height = 0;
+  readImageSize(file, e.width, e.height);
+}
+
+void AdManifest::begin(fs::FS &fs, const char *dir, const char *manifestPath) {
+  _fs = &fs;
+  _dir = dir;
+  _manifestPath = manifestPath;
+  _entries.clear();
+  _totalBytes = 0;
+
+  // Previously persisted entries: only used to skip re-reading headers
+  std::vector<AdEntry> cached;
+  File mf = fs.open(manifestPath, "r");
+  if (mf) {
+    char line[160];
+    while (mf.available()) {
+      size_t len = mf.readBytesUntil('\n', line, sizeof(line) - 1);
+      line[len] = 0;
+      char *tab[4];
+      int n = 0;
+      for (char *c = line; *c && n < 4; c++) {
+        if (*c == '\t') {
+          *c = 0;
+          tab[n++] = c + 1;
+        }
+      }
+      if (n < 4) continue;
+      AdEntry e = {String(line), (uint32_t)strtoul(tab[0], nullptr, 10),
+                   (uint32_t)strtoul(tab[1], nullptr, 10), (uint16_t)atoi(tab[2]),
+                   (uint16_t)atoi(tab[3])};
+      cached.push_back(e);
+    }
+    mf.close();
+  }
+
+  File root = fs.open(dir);
+  if (!root || !root.isDirectory()) return;
+
+  int reused = 0;
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) {
+      AdEntry e;
+      e.name = baseName(file.name());
+      e.size = file.size();
+      e.mtime = (uint32_t)file.getLastWrite();
+      e.width = 0;
+      e.height = 0;
+
+      bool found = false;
+      for (const AdEntry &c : cached) {
+        if (c.name == e.name && c.size == e.size && c.mtime == e.mtime) {
+          e.width = c.width;
+          e.height = c.height;
+          found = true;
+          reused++;
+          break;
+        }
+      }
+      if (!found) readImageSize(file, e.width, e.height);
+
+      _totalBytes += e.size;
+      _entries.push_back(e);
+    }
+    file.close();
+    file = root.openNextFile();
+  }
+  root.close();
+
+  Serial.printf("ADS: Manifest %u files (%u cached), %llu bytes\n", _entries.size(), reused,
+                _totalBytes);
+  _generation++;
+  save();
+}
+
+void AdManifest::save() {
+  if (!_fs) return;
+  File mf = _fs->open(_manifestPath, "w");
+  if (!mf) return;
+  for (const AdEntry &e : _entries) {
+    mf.printf("%s\t%u\t%u\t%u\t%u\n", e.name.c_str(), e.size, e.mtime, e.width, e.height);
+  }
+  mf.close();
+}
+
+int AdManifest::indexOf(const String &name) const {
+  for (size_t i = 0; i < _entries.size(); i++) {
+    if (_entries[i].name == name) return i;
+  }
+  return -1;
+}
+
+void AdManifest::onFileWritten(const String &name) {
+  if (!_fs) return;
+  File file = _fs->open(_dir + "/" + name, "r");
+  if (!file) return;
+
+  int idx = indexOf(name);
+  if (idx < 0) {
+    AdEntry e;
+    e.name = name;
+    _entries.push_back(e);
+    idx = _entries.size() - 1;
+  } else {
+    _totalBytes -= _entries[idx].size;
+  }
+  statEntry(_entries[idx], file);
+  file.close();
+
+  _totalBytes += _entries[idx].size;
+  _generation++;
+  save();
+}
+
+void AdManifest::onFileRemoved(const String &name) {
+  int idx = indexOf(name);
+  if (idx < 0) return;
+  _totalBytes -= _entries[idx].size;
+  _entries.erase(_entries.begin() + idx);
+  _generation++;
+  save();
+}
+
+String AdManifest::toJson() const {
+  String json = "[";
+  for (const AdEntry &e : _entries) {
+    if (json.length() > 1) json += ",";
+    json += "{\"name\":\"" + e.name + "\",\"size\":" + String(e.size) +
+            ",\"mtime\":" + String(e.mtime) + ",\"w\":" + String(e.width) +
+            ",\"h\":" + String(e.height) + "}";
+  }
+  json += "]";
+  return json;
+}
@@ -0,0 +1,59 @@
+#ifndef ADMANIFEST_H
+#define ADMANIFEST_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+
+#define AD_THUMB_DIR "/ads/.thumbs" // Admin previews, <name>.bmp (skipped by the listing)
+#define AD_THUMB_MAX_W 120
+#define AD_THUMB_MAX_H 80
+// 16-bit BMP: 66-byte header plus rows padded to 4 bytes, ~19 KB at 120x80
+#define AD_THUMB_MAX_BYTES (66 + ((AD_THUMB_MAX_W * 2 + 3) & ~3) * AD_THUMB_MAX_H)
+
+struct AdEntry {
+  String name;     // File name inside the ads directory (no path)
+  uint32_t size;
+  uint32_t mtime;
+  uint16_t width;  // 0 if not an image or header unreadable
+  uint16_t height;
+};
+
+// Cached listing of /ads. Built with a single directory pass at mount
+// (reusing the persisted manifest for files whose size/mtime did not change,
+// so image headers are only parsed for new files) and kept up to date by the
+// upload and delete handlers. Listing, quota checks and ad selection then
+// cost no SD I/O. Persisted as tab-separated lines: name, size, mtime, w, h.
+class AdManifest {
+public:
+  AdManifest();
+  void begin(fs::FS &fs, const char *dir, const char *manifestPath);
+
+  void onFileWritten(const String &name);
+  void onFileRemoved(const String &name);
+
+  size_t count() const { return _entries.size(); }
+  const AdEntry &at(size_t i) const { return _entries[i]; }
+  int indexOf(const String &name) const;
+  uint64_t totalBytes() const { return _totalBytes; }
+  // What the ads quota counts: the files plus a worst-case thumbnail each
+  uint64_t quotaBytes() const { return _totalBytes + (uint64_t)_entries.size() * AD_THUMB_MAX_BYTES; }
+  uint32_t generation() const { return _generation; } // Bumped on every change
+  String toJson() const;
+  static String thumbnailPath(const String &name) { return String(AD_THUMB_DIR "/") + name + ".bmp"; }
+
+private:
+  fs::FS *_fs = nullptr;
+  String _dir;
+  String _manifestPath;
+  std::vector<AdEntry> _entries;
+  uint64_t _totalBytes = 0;
+  uint32_t _generation = 0;
+
+  void save();
+  void statEntry(AdEntry &e, File &file);
+  static bool readImageSize(File &file, uint16_t &w, uint16_t &h);
+  static String baseName(const char *path);
+};
+
+#endif
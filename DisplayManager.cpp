@@ -1,5 +1,7 @@
 #include "DisplayManager.h"
 #include "SoundManager.h"
+#include "MemoryManager.h"
+#include "PngEncoder.h"
 
 #include "qrcode.h"
 #include <FS.h>
@@ -17,9 +19,8 @@ public:
     bool begin(int32_t speed = GFX_NOT_DEFINED) override {
         if (!_framebuffer) {
             size_t s = (size_t)_width * _height * 2;
-            _framebuffer = (uint16_t *)ps_malloc(s);
-            if (_framebuffer) Serial.println("Canvas allocated in PSRAM");
-            else Serial.println("Canvas PSRAM allocation failed, falling back to SRAM");
+            // Lives for the whole run; Arduino_Canvas never frees it
+            _framebuffer = (uint16_t *)memoryManager.alloc(MEM_DISPLAY, s);
         }
         return Arduino_Canvas::begin(speed);
     }
@@ -29,14 +30,23 @@ DisplayManager::DisplayManager() {
     instance = this;
     bus = new Arduino_ESP32QSPI(45, 47, 21, 48, 40, 39);
     gfx = new Arduino_AXS15231B(bus, GFX_NOT_DEFINED, 0, false, 320, 480);
-    canvas = new Arduino_Canvas_PSRAM(320, 480, gfx, 0, 0, 0);
     touch = new AXS15231B_Touch(8, 4, 3, 0x3B, 1); // SDA=4, SCL=8, INT=3
 }
 
 void DisplayManager::begin() {
+    unsigned long t0 = millis();
+    _uiQueue = xQueueCreate(UI_QUEUE_LEN, sizeof(UiCommand));
+    _eventQueue = xQueueCreate(UI_EVENT_QUEUE_LEN, sizeof(UiEvent));
+    _playlistLock = xSemaphoreCreateMutex();
+    _captureDone = xSemaphoreCreateBinary();
+    _captureRelease = xSemaphoreCreateBinary();
+
     pinMode(1, OUTPUT);
     digitalWrite(1, HIGH); // Backlight
 
+    memoryManager.setBudget(MEM_LVGL, DISPLAY_DRAW_BUF_BYTES + 64);
+
+    canvas = new Arduino_Canvas_PSRAM(320, 480, gfx, 0, 0, 0);
     if (!canvas->begin()) {
         Serial.println("Display Init Failed!");
         return;
@@ -51,18 +61,17 @@ void DisplayManager::begin() {
         touch->setOffsets(0, 320, 320, 0, 480, 480);
         touch->setRotation(1);
     }
+    _boot.panelMs = millis() - t0;
 
     initLVGL();
+    _boot.lvglMs = millis() - t0 - _boot.panelMs;
+    // Only the splash is built now; the rest on first use (ensureScreen)
     createStartupUI();
-    createKeypadUI();
-    createQRUI();
-    createReadyUI();
-    createSuccessUI();
-    createAdsUI();
+    createPopups();
     
-    // Allocate Ad Buffer in PSRAM (480x320x2 bytes)
-    _ad_buffer = (uint16_t *)ps_malloc(480 * 320 * sizeof(uint16_t));
-    if (!_ad_buffer) _ad_buffer = (uint16_t *)malloc(480 * 320 * sizeof(uint16_t));
+    // Decode task on the other core; frames are allocated on first decode
+    _adDecoder.begin();
+    _ad_buffer = _adDecoder.front();
     
     // Setup LVGL Image Descriptor for the Ad
     _ad_img_dsc.header.cf = LV_COLOR_FORMAT_RGB565;
@@ -72,17 +81,27 @@ void DisplayManager::begin() {
     _ad_img_dsc.data_size = 480 * 320 * 2;
     _ad_img_dsc.data = (const uint8_t *)_ad_buffer;
 
-    // Initialize TJpgDec
-    TJpgDec.setJpgScale(1);
-    TJpgDec.setCallback(tft_output);
-
     // Initial load: keep it on scr_startup until WiFi flow decides
     lv_screen_load(scr_startup);
     _lastActivity = millis();
+
+    _boot.beginMs = millis() - t0;
+    _boot.beginEndMs = millis();
+
+    // From here on only the UI task touches LVGL
+    xTaskCreatePinnedToCore(uiTaskEntry, "ui", UI_TASK_STACK, this, UI_TASK_PRIORITY, NULL, 1);
+
+    TaskHandle_t touchTask = nullptr;
+    xTaskCreatePinnedToCore(touchTaskEntry, "touch", 3072, this, TOUCH_TASK_PRIORITY, &touchTask, 0);
+    touch->setNotifyTask(touchTask);
+
+    Serial.printf("BOOT: display begin %lu ms (panel %lu, lvgl %lu), heap %u, psram %u\n", _boot.beginMs,
+                  _boot.panelMs, _boot.lvglMs, ESP.getFreeHeap(), ESP.getFreePsram());
 }
 
 void DisplayManager::initLVGL() {
     lv_init();
+    lv_tick_set_cb([]() -> uint32_t { return millis(); });
     
 #if LV_USE_LOG
     lv_log_register_print_cb([](lv_log_level_t level, const char * buf) {
@@ -90,39 +109,239 @@ void DisplayManager::initLVGL() {
     });
 #endif
     
-    uint32_t screenWidth = canvas->width();
-    uint32_t screenHeight = canvas->height();
-    uint32_t bufSize = screenWidth * screenHeight / 10;
-    
-    lv_color_t *buf = (lv_color_t *)ps_malloc(bufSize * sizeof(lv_color_t));
-    if (!buf) buf = (lv_color_t *)malloc(bufSize * sizeof(lv_color_t)); // Fallback
+    _drawBuf = (uint8_t *)memoryManager.alloc(MEM_LVGL, DISPLAY_DRAW_BUF_BYTES);
+    if (!_drawBuf) {
+        Serial.println("CRITICAL: LVGL draw buffer allocation failed");
+        return;
+    }
     
-    lv_display_t *disp = lv_display_create(screenWidth, screenHeight);
+    lv_display_t *disp = lv_display_create(DISPLAY_WIDTH, DISPLAY_HEIGHT);
     lv_display_set_user_data(disp, this);
     lv_display_set_flush_cb(disp, [](lv_display_t *d, const lv_area_t *a, uint8_t *px) {
         uint32_t w = lv_area_get_width(a);
         uint32_t h = lv_area_get_height(a);
+        unsigned long t0 = micros();
         instance->canvas->draw16bitRGBBitmap(a->x1, a->y1, (uint16_t *)px, w, h);
-        if (lv_display_flush_is_last(d)) instance->canvas->flush();
+        bool last = lv_display_flush_is_last(d);
+        if (last) instance->canvas->flush(); // Whole frame, whatever changed
+        instance->onFlushed(last ? DISPLAY_WIDTH * DISPLAY_HEIGHT : 0, micros() - t0, last);
         lv_disp_flush_ready(d);
     });
-    lv_display_set_buffers(disp, buf, NULL, bufSize * sizeof(lv_color_t), LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_set_buffers(disp, _drawBuf, NULL, DISPLAY_DRAW_BUF_BYTES, LV_DISPLAY_RENDER_MODE_PARTIAL);
+
+    // Render time: from refresh start until every area is handed to flush
+    lv_display_add_event_cb(disp, [](lv_event_t *e) {
+        instance->_refrStartedAt = micros();
+    }, LV_EVENT_REFR_START, NULL);
+    lv_display_add_event_cb(disp, [](lv_event_t *e) {
+        if (instance->_refrStartedAt) instance->_perfRender.add(micros() - instance->_refrStartedAt);
+    }, LV_EVENT_REFR_READY, NULL);
+
+    _indev = lv_indev_create();
+    lv_indev_set_type(_indev, LV_INDEV_TYPE_POINTER);
+    lv_indev_set_read_cb(_indev, [](lv_indev_t *i, lv_indev_data_t *data) {
+        if (instance->_injectUntil) {
+            // Scripted tap from injectTouch(): held until its deadline, then
+            // one released sample so LVGL sees the click
+            if ((long)(millis() - instance->_injectUntil) < 0) {
+                data->point.x = instance->_injectX;
+                data->point.y = instance->_injectY;
+                data->state = LV_INDEV_STATE_PRESSED;
+                instance->uiAddActivity();
+            } else {
+                instance->_injectUntil = 0;
+                data->state = LV_INDEV_STATE_RELEASED;
+            }
+            return;
+        }
+        instance->readTouch(data);
+    });
+}
 
-    lv_indev_t *indev = lv_indev_create();
-    lv_indev_set_type(indev, LV_INDEV_TYPE_POINTER);
-    lv_indev_set_read_cb(indev, [](lv_indev_t *i, lv_indev_data_t *data) {
-        if (instance->touch->touched()) {
+// Sleeps until the touch interrupt, reads the point once and queues it.
+// A point identical to the last one is dropped here; a finger that stops
+// producing interrupts for TOUCH_RELEASE_MS is queued as released.
+void DisplayManager::touchTaskEntry(void * arg) {
+    DisplayManager * self = (DisplayManager *)arg;
+    TouchSample last = {0, 0, false, 0};
+    for (;;) {
+        TickType_t wait = last.pressed ? pdMS_TO_TICKS(TOUCH_RELEASE_MS) : portMAX_DELAY;
+        TouchSample sample = last;
+        if (ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            if (!self->touch->touched()) continue;
             uint16_t x, y;
-            instance->touch->readData(&x, &y);
-            data->point.x = x;
-            data->point.y = y;
-            data->state = LV_INDEV_STATE_PRESSED;
-            Serial.printf("Touch detected at X:%d, Y:%d\n", x, y);
-            instance->addActivity(); // Reset inactivity on any touch
+            self->touch->readData(&x, &y);
+            sample = {(int16_t)x, (int16_t)y, true, self->touch->lastInterruptUs()};
+            self->_perfTouchRead.add(micros() - sample.irqUs);
+            if (last.pressed && sample.x == last.x && sample.y == last.y) {
+                self->_touchCoalesced++;
+                continue;
+            }
         } else {
-            data->state = LV_INDEV_STATE_RELEASED;
+            sample.pressed = false;
+            sample.irqUs = micros();
         }
-    });
+        if (!self->pushTouch(sample)) continue; // Full: a release is retried after the next timeout
+        last = sample;
+        if (!self->_touchWake) {
+            self->_touchWake = true;
+            self->post(UI_TOUCH);
+        }
+    }
+}
+
+bool DisplayManager::pushTouch(const TouchSample & sample) {
+    uint8_t head = _touchHead;
+    if ((uint8_t)(head - __atomic_load_n(&_touchTail, __ATOMIC_ACQUIRE)) >= TOUCH_RING_SIZE) {
+        _touchDropped++;
+        return false;
+    }
+    _touchRing[head % TOUCH_RING_SIZE] = sample;
+    __atomic_store_n(&_touchHead, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+    _touchSamples++;
+    return true;
+}
+
+// LVGL indev read (UI task). Drains the ring; consecutive pressed samples
+// collapse into the newest so a burst of moves costs one event, while
+// presses and releases are always delivered (continue_reading).
+void DisplayManager::readTouch(lv_indev_data_t * data) {
+    _touchWake = false;
+    uint8_t tail = _touchTail;
+    uint8_t head = __atomic_load_n(&_touchHead, __ATOMIC_ACQUIRE);
+    if (tail != head) {
+        TouchSample sample = _touchRing[tail++ % TOUCH_RING_SIZE];
+        while (sample.pressed && tail != head && _touchRing[tail % TOUCH_RING_SIZE].pressed) {
+            sample = _touchRing[tail++ % TOUCH_RING_SIZE];
+            _touchCoalesced++;
+        }
+        __atomic_store_n(&_touchTail, tail, __ATOMIC_RELEASE);
+
+        _perfTouchIndev.add(micros() - sample.irqUs);
+        if (!_touchRenderFrom) _touchRenderFrom = sample.irqUs;
+        _touchLast = sample;
+        if (sample.pressed) uiAddActivity(); // Reset inactivity on any touch
+        data->continue_reading = tail != head;
+    }
+    data->point.x = _touchLast.x;
+    data->point.y = _touchLast.y;
+    data->state = _touchLast.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+}
+
+// Called per flushed area
+void DisplayManager::onFlushed(uint32_t pixels, uint32_t busUs, bool last) {
+    _flushStats.areas++;
+    _flushStats.pixels += pixels;
+    _flushStats.busUs += busUs;
+    _framePixels += pixels;
+    _frameBusUs += busUs;
+    if (!last) return;
+
+    unsigned long now = micros();
+    if (_transitionAt) {
+        _perfTransition.add(now - _transitionAt);
+        _transitionAt = 0;
+    }
+    if (!_boot.firstFrameMs) _boot.firstFrameMs = millis();
+    if (_touchRenderFrom) {
+        // A touch that changed nothing is matched to the next unrelated
+        // frame; those land past the cutoff and are ignored
+        uint32_t latency = now - _touchRenderFrom;
+        if (latency < 500000) _perfTouchRender.add(latency);
+        _touchRenderFrom = 0;
+    }
+    _perfFlush.add(_frameBusUs);
+    _perfBytes.add(_framePixels * 2);
+    if (_lastFrameAt && now - _lastFrameAt < 1000000) _perfInterval.add(now - _lastFrameAt);
+    _lastFrameAt = now;
+    _framePixels = 0;
+    _frameBusUs = 0;
+    _flushStats.frames++;
+    _frameCount++;
+}
+
+// FPS and overlay once a second; histogram decay and bus log every 10 s
+void DisplayManager::updatePerf() {
+    unsigned long now = millis();
+    if (_boot.firstFrameMs && !_boot.logged) {
+        _boot.logged = true;
+        Serial.printf("BOOT: first frame at %lu ms after reset (%lu ms after display begin)\n",
+                      _boot.firstFrameMs, _boot.firstFrameMs - _boot.beginEndMs);
+    }
+    if (now - _fpsSince >= 1000) {
+        uint32_t frames = _frameCount;
+        _fps = (frames - _fpsFrames) * 1000 / (now - _fpsSince);
+        _fpsFrames = frames;
+        _fpsSince = now;
+
+        if (_perfOverlay && !lv_obj_has_flag(_perfOverlay, LV_OBJ_FLAG_HIDDEN)) {
+            char text[128];
+            snprintf(text, sizeof(text), "%u fps  render p50 %.1f p95 %.1f ms\nflush p50 %.1f ms  %u KB/frame",
+                     _fps, _perfRender.percentile(50) / 1000.0f, _perfRender.percentile(95) / 1000.0f,
+                     _perfFlush.percentile(50) / 1000.0f, _perfBytes.last() / 1024);
+            lv_label_set_text(_perfOverlay, text);
+        }
+    }
+
+    if (now - _perfDecayedAt < 10000) return;
+    _perfDecayedAt = now;
+    _perfRender.decay();
+    _perfFlush.decay();
+    _perfBytes.decay();
+    _perfInterval.decay();
+    _perfTouchRead.decay();
+    _perfTouchIndev.decay();
+    _perfTouchRender.decay();
+    _perfKeypad.decay();
+
+    if (_flushStats.frames > 0) {
+        Serial.printf("DISP: %u frames, %u areas, %u KB pushed in %u ms (full-frame would be %u KB)\n",
+                      _flushStats.frames, _flushStats.areas, _flushStats.pixels * 2 / 1024,
+                      _flushStats.busUs / 1000, _flushStats.frames * DISPLAY_WIDTH * DISPLAY_HEIGHT * 2 / 1024);
+    }
+    _flushStats = FlushStats();
+    _flushStats.since = now;
+}
+
+void DisplayManager::uiSetPerfOverlay(bool visible) {
+    if (!_perfOverlay) {
+        // Top layer: stays above every screen, including the ads
+        _perfOverlay = lv_label_create(lv_layer_top());
+        lv_obj_set_style_bg_color(_perfOverlay, lv_color_black(), 0);
+        lv_obj_set_style_bg_opa(_perfOverlay, LV_OPA_70, 0);
+        lv_obj_set_style_text_color(_perfOverlay, lv_color_hex(0x00FF00), 0);
+        lv_obj_set_style_pad_all(_perfOverlay, 4, 0);
+        lv_obj_align(_perfOverlay, LV_ALIGN_TOP_RIGHT, 0, 0);
+        lv_label_set_text(_perfOverlay, "...");
+    }
+    _perfOverlayVisible = visible;
+    if (visible) lv_obj_remove_flag(_perfOverlay, LV_OBJ_FLAG_HIDDEN);
+    else lv_obj_add_flag(_perfOverlay, LV_OBJ_FLAG_HIDDEN);
+}
+
+String DisplayManager::getPerfJson() {
+    String json = "{\"fps\":" + String(_fps) + ",\"frames\":" + String(_frameCount);
+    char boot[128];
+    snprintf(boot, sizeof(boot), ",\"boot\":{\"panelMs\":%lu,\"lvglMs\":%lu,\"beginMs\":%lu,\"firstFrameMs\":%lu}",
+             _boot.panelMs, _boot.lvglMs, _boot.beginMs, _boot.firstFrameMs);
+    json += boot;
+    json += ",\"overlay\":" + String(_perfOverlayVisible ? "true" : "false");
+    json += ",\"uiQueue\":{\"depth\":" + String(uxQueueMessagesWaiting(_uiQueue)) + ",\"peak\":" + String(_uiQueuePeak) +
+            ",\"dropped\":" + String(_uiQueueDropped) + "}";
+    json += ",\"renderUs\":" + _perfRender.toJson();
+    json += ",\"flushUs\":" + _perfFlush.toJson();
+    json += ",\"bytesPerFrame\":" + _perfBytes.toJson();
+    json += ",\"frameIntervalUs\":" + _perfInterval.toJson();
+    json += ",\"transitionUs\":" + _perfTransition.toJson();
+    json += ",\"qrUs\":" + _perfQr.toJson();
+    json += ",\"keypadUs\":" + _perfKeypad.toJson();
+    json += ",\"popups\":{\"calls\":" + String(_popupCalls) + ",\"lvglAllocs\":" + String(_popupAllocs) +
+            ",\"lastAllocs\":" + String(_popupLastAllocs) + "}";
+    json += ",\"touch\":{\"samples\":" + String(_touchSamples) + ",\"coalesced\":" + String(_touchCoalesced) +
+            ",\"dropped\":" + String(_touchDropped) + ",\"readUs\":" + _perfTouchRead.toJson() +
+            ",\"indevUs\":" + _perfTouchIndev.toJson() + ",\"renderUs\":" + _perfTouchRender.toJson() + "}";
+    json += "}";
+    return json;
 }
 
 void DisplayManager::createStartupUI() {
@@ -191,7 +410,7 @@ void DisplayManager::createKeypadUI() {
     lv_obj_set_style_text_font(lbl_unit_price, &lv_font_montserrat_20, 0); // INCREASED FONT
     lv_obj_set_style_text_color(lbl_unit_price, lv_color_hex(0xAAAAAA), 0);
     lv_obj_align(lbl_unit_price, LV_ALIGN_TOP_RIGHT, -20, 50);
-    setOperationMode(_opMode); // Initialize with actual values
+    uiSetOperationMode(_opMode); // Initialize with actual values
 
     lbl_price_display = lv_label_create(scr_keypad);
     lv_label_set_text(lbl_price_display, "Total: $0.00");
@@ -243,8 +462,10 @@ void DisplayManager::createKeypadUI() {
     lv_obj_align(lbl_static_qr_text, LV_ALIGN_CENTER, 0, -60); // Above center
     lv_obj_add_flag(lbl_static_qr_text, LV_OBJ_FLAG_HIDDEN); // Hidden by default
 
-    // Initial State Check
-    setOperationMode(_opMode);
+    // Initial State Check (settings may have arrived before the screen)
+    uiSetOperationMode(_opMode);
+    uiSetFixedModeConfig(_fixedUnits);
+    uiSetWiFiStatus(_wifiConnected);
 }
 
 void DisplayManager::createAdsUI() {
@@ -268,8 +489,8 @@ void DisplayManager::createAdsUI() {
     lv_obj_center(lbl_start);
 
     auto exit_cb = [](lv_event_t * e) {
-        instance->stopAds();
-        instance->showKeypad();
+        instance->uiStopAds();
+        instance->uiShowKeypad();
     };
 
     lv_obj_add_event_cb(btn_start, exit_cb, LV_EVENT_CLICKED, NULL);
@@ -281,10 +502,8 @@ void DisplayManager::event_handler_num(lv_event_t * e) {
     uint32_t id = lv_buttonmatrix_get_selected_button(obj);
     const char * txt = lv_buttonmatrix_get_button_text(obj, id);
     
-    // Play Click Sound
-    if(instance->_soundManager) {
-        ((SoundManager*)instance->_soundManager)->playClick();
-    }
+    // Only sets a bit for the synth task, so it is fine on the UI task
+    if (instance->_soundManager) ((SoundManager*)instance->_soundManager)->playClick();
     
     if (strcmp(txt, "C") == 0) {
         instance->currentAmountStr = "0";
@@ -302,94 +521,68 @@ void DisplayManager::event_handler_num(lv_event_t * e) {
     }
     lv_label_set_text(instance->lbl_amount, instance->currentAmountStr.c_str());
     
-    // Update total price display with Promo Logic
-    int amount = instance->currentAmountStr.toInt();
-    float total = amount * instance->_pricePerUnit;
-    
-    // Reset Promo Label
-    if(instance->lbl_promo_info) lv_label_set_text(instance->lbl_promo_info, "");
+    unsigned long t0 = micros();
+    instance->updateKeypadTotal(instance->currentAmountStr.toInt());
+    instance->_perfKeypad.add(micros() - t0);
     
-    // Check Promotion
-    if (instance->_promoEnabled && amount >= instance->_promoThreshold) {
-        float discountFactor = (100.0 - instance->_promoValue) / 100.0;
-        total = total * discountFactor;
-        
-        char pBuf[32];
-        sprintf(pBuf, "Desc. %.0f%% Aplicado!", instance->_promoValue);
-        if(instance->lbl_promo_info) lv_label_set_text(instance->lbl_promo_info, pBuf);
+    instance->uiAddActivity();
+}
+
+// Total (and promo note) for `units` on the keypad, from the shared rules
+void DisplayManager::updateKeypadTotal(int units) {
+    PriceQuote q = _pricing.quote(units);
+
+    if (lbl_promo_info) {
+        if (q.promoApplied) {
+            char pBuf[32];
+            snprintf(pBuf, sizeof(pBuf), "Desc. %d%% Aplicado!", (int)((_pricing.discountBasisPoints() + 50) / 100));
+            lv_label_set_text(lbl_promo_info, pBuf);
+        } else {
+            lv_label_set_text_static(lbl_promo_info, "");
+        }
     }
 
-    char buf[32];
-    sprintf(buf, "Total: $%.2f", total);
-    lv_label_set_text(instance->lbl_price_display, buf);
-    
-    instance->addActivity();
+    char buf[32] = "Total: $";
+    PriceRules::format(buf + 8, sizeof(buf) - 8, q.totalCentavos);
+    if (lbl_price_display) lv_label_set_text(lbl_price_display, buf);
+}
+
+void DisplayManager::updatePricing() {
+    _pricing = PriceRules::fromSettings(_pricePerUnit, _opMode, _promoEnabled, _promoThreshold, _promoValue);
 }
 
 void DisplayManager::event_handler_gen(lv_event_t * e) {
-    if(instance->_soundManager) ((SoundManager*)instance->_soundManager)->playQrGenerated();
+    instance->postEvent(UI_EVENT_QR_SOUND);
     
     // Validate Amount
     if (instance->currentAmountStr == "" || instance->currentAmountStr == "0") return;
     
-    float amount = instance->currentAmountStr.toFloat();
-    // Validate Minimum
-    if (amount < instance->_pricePerUnit) {
-         instance->showWarning("Mínimo: $" + String(instance->_pricePerUnit, 0));
-         return;
-    }
-    
-    // NOTE: Do NOT apply discount here. Pass raw units to main loop.
-    // The main loop calculates the price discount.
-    // Making sure we verify against pricePerUnit correctly above logic only checks raw value.
+    // The typed number is units, exactly what updateKeypadTotal() priced.
+    // NOTE: Do NOT apply discount here. Pass raw units to main loop,
+    // which prices them with the same PriceRules.
+    int units = instance->currentAmountStr.toInt();
 
-    if (instance->_paymentCallback) {
-        // Convert Amount to Units based on PricePerUnit
-        int units = (int)(amount / instance->_pricePerUnit);
-        if (units < 1) units = 1;
-
-        // Trigger Callback (Main Loop will handle MP creation)
-        instance->_paymentCallback(units); 
-    }
+    // Main Loop runs the callback and handles MP creation
+    instance->postEvent(UI_EVENT_PAYMENT, units);
 }
 
-void DisplayManager::showStartup(String msg) {
+void DisplayManager::uiShowStartup(const char * msg) {
     if (!lbl_status) return;
     lv_obj_set_style_text_font(lbl_status, &lv_font_montserrat_20, 0);
-    lv_label_set_text(lbl_status, msg.c_str());
-    lv_screen_load(scr_startup);
-}
-
-void DisplayManager::showAPInfo(String ssid, String pass, String url) {
-    if (!lbl_status) return;
-    
-    char buf[256];
-    sprintf(buf, "MODO CONFIGURACION\n\nConectar a Wifi:\n%s\n\nPanel Admin:\n%s", 
-            ssid.c_str(), url.c_str());
-    
-    lv_obj_set_style_text_font(lbl_status, &lv_font_montserrat_14, 0);
-    lv_label_set_text(lbl_status, buf);
-    lv_screen_load(scr_startup);
+    lv_label_set_text(lbl_status, msg);
+    loadScreen(scr_startup);
 }
 
-void DisplayManager::showConnectionSuccess(String ip, String url) {
+void DisplayManager::uiShowInfo(const char * text) {
     if (!lbl_status) return;
-    
-    char buf[256];
-    sprintf(buf, "CONECTADO EXITOSAMENTE\n\nIP: %s\n\nURL: %s\n\nIniciando teclado...", 
-            ip.c_str(), url.c_str());
-    
     lv_obj_set_style_text_font(lbl_status, &lv_font_montserrat_14, 0);
-    lv_label_set_text(lbl_status, buf);
-    lv_screen_load(scr_startup);
-    
-    _showingInfo = true;
-    _infoStartTime = millis();
+    lv_label_set_text(lbl_status, text);
+    loadScreen(scr_startup);
 }
 
-void DisplayManager::showKeypad() {
+void DisplayManager::uiShowKeypad() {
     _showingInfo = false;
-    lv_screen_load(scr_keypad);
+    loadScreen(keypadScreen());
 }
 
 void DisplayManager::createQRUI() {
@@ -408,40 +601,44 @@ void DisplayManager::createQRUI() {
     lv_obj_align(btn_back, LV_ALIGN_TOP_LEFT, 10, 10);
     lv_label_set_text(lv_label_create(btn_back), "CANCELAR");
     lv_obj_add_event_cb(btn_back, [](lv_event_t*e){ 
-        if (instance->_cancelCallback) instance->_cancelCallback();
-        lv_screen_load(instance->scr_keypad); 
+        instance->postEvent(UI_EVENT_CANCEL);
+        instance->loadScreen(instance->keypadScreen()); 
     }, LV_EVENT_CLICKED, NULL);
 
     qr_canvas = lv_canvas_create(scr_qr);
     lv_obj_set_size(qr_canvas, 240, 240); // 20% larger than 200
     lv_obj_align(qr_canvas, LV_ALIGN_CENTER, 0, -10);
     
-    // Allocate QR buffer in PSRAM
-    if (qr_buffer) free(qr_buffer);
-    qr_buffer = (lv_color_t *)ps_malloc(240 * 240 * sizeof(lv_color_t));
-    if (!qr_buffer) {
-        Serial.println("QR Buffer PSRAM failed, using SRAM");
-        qr_buffer = (lv_color_t *)malloc(240 * 240 * sizeof(lv_color_t));
-    } else {
-        Serial.println("QR Buffer allocated in PSRAM");
-    }
-    lv_canvas_set_buffer(qr_canvas, qr_buffer, 240, 240, LV_COLOR_FORMAT_RGB565);
+    // QR canvas buffer is acquired in showQR() and released with the ads
     lbl_total = lv_label_create(scr_qr);
     lv_obj_set_style_text_color(lbl_total, lv_color_black(), 0);
     lv_obj_set_style_text_font(lbl_total, &lv_font_montserrat_20, 0);
     lv_obj_align(lbl_total, LV_ALIGN_BOTTOM_MID, 0, -15);
 }
 
-void DisplayManager::showQR(String url, float total) {
-    if(_soundManager) ((SoundManager*)_soundManager)->playClick(); // Feedback for QR Ready
-
-    Serial.printf("showQR START. URL length: %d, Free Heap: %u\n", url.length(), ESP.getFreeHeap());
+void DisplayManager::uiShowQR(const char * url, float total) {
+    unsigned long t0 = micros();
+    // A payment can arrive during the carousel: stop it so the cache is
+    // actually released and nothing decodes behind the QR
+    uiStopAds();
+    releaseAdMemory(); // QR rendering gets the PSRAM the ad cache was using
+    Serial.printf("showQR START. URL length: %d, Free Heap: %u\n", strlen(url), ESP.getFreeHeap());
     Serial.flush();
-    lv_screen_load(scr_qr);
+    loadScreen(qrScreen());
     String totalStr = "Pagar: $" + String(total, 2);
     lv_label_set_text(lbl_total, totalStr.c_str());
     
     Serial.println("Initializing QR data..."); Serial.flush();
+
+    if (!qr_buffer) {
+        // RGB565 canvas: 2 bytes a pixel (v9's lv_color_t is 3)
+        qr_buffer = (lv_color_t *)memoryManager.alloc(MEM_QR, 240 * 240 * 2);
+        if (!qr_buffer) {
+            uiSetError("Error: Sin memoria");
+            return;
+        }
+        lv_canvas_set_buffer(qr_canvas, qr_buffer, 240, 240, LV_COLOR_FORMAT_RGB565);
+    }
     
     // Choose version based on data length. Version 15 is safer for typical MP URLs.
     uint8_t qrVersion = 15;
@@ -449,10 +646,13 @@ void DisplayManager::showQR(String url, float total) {
     uint16_t bufferSize = qrcode_getBufferSize(qrVersion);
     
     // Use PSRAM for the modules buffer too
-    uint8_t *qrcodeData = (uint8_t *)ps_malloc(bufferSize);
-    if (!qrcodeData) qrcodeData = (uint8_t *)malloc(bufferSize);
+    uint8_t *qrcodeData = (uint8_t *)memoryManager.alloc(MEM_QR, bufferSize);
+    if (!qrcodeData) {
+        uiSetError("Error: Sin memoria");
+        return;
+    }
 
-    if (qrcode_initText(&qrcode, qrcodeData, qrVersion, ECC_LOW, url.c_str()) == 0) {
+    if (qrcode_initText(&qrcode, qrcodeData, qrVersion, ECC_LOW, url) == 0) {
         Serial.println("Drawing to canvas..."); Serial.flush();
         lv_canvas_fill_bg(qr_canvas, lv_color_white(), LV_OPA_COVER);
         
@@ -476,10 +676,11 @@ void DisplayManager::showQR(String url, float total) {
         Serial.println("QR Drawing complete."); Serial.flush();
     } else {
         Serial.println("QR Init Failed! URL might be too long or memory allocation failed.");
-        setError("Error: URL too long");
+        uiSetError("Error: URL too long");
     }
     
-    if (qrcodeData) free(qrcodeData);
+    memoryManager.free(MEM_QR, qrcodeData);
+    _perfQr.add(micros() - t0);
 }
 
 void DisplayManager::createReadyUI() {
@@ -511,9 +712,7 @@ void DisplayManager::createReadyUI() {
     lv_obj_center(lbl_act);
 
     lv_obj_add_event_cb(btn_act, [](lv_event_t * e){
-        if (instance->_activationCallback) {
-            instance->_activationCallback();
-        }
+        instance->postEvent(UI_EVENT_ACTIVATE);
     }, LV_EVENT_CLICKED, NULL);
 
     lv_obj_t * lbl_warn = lv_label_create(scr_ready);
@@ -546,70 +745,113 @@ void DisplayManager::createSuccessUI() {
     lv_obj_align(lbl_msg, LV_ALIGN_BOTTOM_MID, 0, -40);
 }
 
-void DisplayManager::showReady() {
+void DisplayManager::uiShowReady() {
+    uiStopAds();
     Serial.println("UI: Showing Ready to Activate Screen...");
-    lv_screen_load(scr_ready);
+    releaseAdMemory();
+    loadScreen(readyScreen());
 }
 
-void DisplayManager::setError(String msg) {
-    lv_screen_load(scr_keypad);
-    lv_label_set_text(lbl_amount, msg.c_str());
+// Error text stays on the amount label for 3 s. A new error restarts the
+// same timer instead of stacking another one.
+void DisplayManager::uiSetError(const char * msg) {
+    lv_mem_monitor_t before;
+    lv_mem_monitor(&before);
+    loadScreen(keypadScreen());
+    strlcpy(_errorText, msg, sizeof(_errorText));
+    lv_label_set_text_static(lbl_amount, _errorText);
     lv_obj_set_style_text_color(lbl_amount, lv_palette_main(LV_PALETTE_RED), 0);
-    
-    lv_timer_create([](lv_timer_t * t){
-        if (instance) {
-            lv_label_set_text(instance->lbl_amount, instance->currentAmountStr.c_str());
-            lv_obj_set_style_text_color(instance->lbl_amount, lv_color_white(), 0);
-        }
-    }, 3000, NULL);
+    restartTimer(_errorTimer);
+    countPopupAllocs(before);
 }
 
-void DisplayManager::showWarning(String msg) {
-    Serial.println("UI: Showing Warning: " + msg);
-    
-    // Create a custom popup using a basic object
-    lv_obj_t * mbox = lv_obj_create(lv_screen_active());
-    lv_obj_set_size(mbox, 300, 150);
-    lv_obj_center(mbox);
-    lv_obj_set_style_bg_color(mbox, lv_palette_main(LV_PALETTE_ORANGE), 0);
-    lv_obj_set_style_border_width(mbox, 2, 0);
-    lv_obj_set_style_border_color(mbox, lv_color_white(), 0);
-    lv_obj_set_style_radius(mbox, 10, 0);
-    lv_obj_set_style_shadow_width(mbox, 20, 0);
-    lv_obj_set_style_shadow_color(mbox, lv_color_hex(0x000000), 0);
-    lv_obj_set_style_shadow_opa(mbox, LV_OPA_50, 0);
-
-    lv_obj_t * title = lv_label_create(mbox);
-    lv_label_set_text(title, "AVISO");
+// Built once in begin(): hidden on the top layer, so it shows over any
+// screen, and retexted by uiShowWarning()
+void DisplayManager::createPopups() {
+    _warningBox = lv_obj_create(lv_layer_top());
+    lv_obj_set_size(_warningBox, 300, 150);
+    lv_obj_center(_warningBox);
+    lv_obj_set_style_bg_color(_warningBox, lv_palette_main(LV_PALETTE_ORANGE), 0);
+    lv_obj_set_style_border_width(_warningBox, 2, 0);
+    lv_obj_set_style_border_color(_warningBox, lv_color_white(), 0);
+    lv_obj_set_style_radius(_warningBox, 10, 0);
+    lv_obj_set_style_shadow_width(_warningBox, 20, 0);
+    lv_obj_set_style_shadow_color(_warningBox, lv_color_hex(0x000000), 0);
+    lv_obj_set_style_shadow_opa(_warningBox, LV_OPA_50, 0);
+    lv_obj_add_flag(_warningBox, LV_OBJ_FLAG_HIDDEN);
+
+    lv_obj_t * title = lv_label_create(_warningBox);
+    lv_label_set_text_static(title, "AVISO");
     lv_obj_set_style_text_font(title, &lv_font_montserrat_20, 0);
     lv_obj_set_style_text_color(title, lv_color_white(), 0);
     lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 10);
 
-    lv_obj_t * body = lv_label_create(mbox);
-    lv_label_set_text(body, msg.c_str());
-    lv_obj_set_style_text_color(body, lv_color_white(), 0);
-    lv_obj_set_style_text_align(body, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_set_width(body, 280);
-    lv_obj_align(body, LV_ALIGN_CENTER, 0, 10);
+    _warningLabel = lv_label_create(_warningBox);
+    lv_label_set_text_static(_warningLabel, _warningText);
+    lv_obj_set_style_text_color(_warningLabel, lv_color_white(), 0);
+    lv_obj_set_style_text_align(_warningLabel, LV_TEXT_ALIGN_CENTER, 0);
+    lv_obj_set_width(_warningLabel, 280);
+    lv_obj_align(_warningLabel, LV_ALIGN_CENTER, 0, 10);
+
+    // One-shot behaviour: each timer pauses itself and is restarted on use
+    _warningTimer = lv_timer_create([](lv_timer_t * t) {
+        lv_obj_add_flag(instance->_warningBox, LV_OBJ_FLAG_HIDDEN);
+        lv_timer_pause(t);
+    }, 5000, NULL);
+    lv_timer_pause(_warningTimer);
+
+    _errorTimer = lv_timer_create([](lv_timer_t * t) {
+        lv_label_set_text(instance->lbl_amount, instance->currentAmountStr.c_str());
+        lv_obj_set_style_text_color(instance->lbl_amount, lv_color_white(), 0);
+        lv_timer_pause(t);
+    }, 3000, NULL);
+    lv_timer_pause(_errorTimer);
+
+    _successTimer = lv_timer_create([](lv_timer_t * t) {
+        instance->loadScreen(instance->keypadScreen());
+        instance->currentAmountStr = "0";
+        lv_label_set_text_static(instance->lbl_amount, "0");
+        lv_label_set_text_static(instance->lbl_price_display, "Total: $0.00");
+        lv_timer_pause(t);
+    }, 10000, NULL);
+    lv_timer_pause(_successTimer);
+}
+
+void DisplayManager::restartTimer(lv_timer_t * timer) {
+    lv_timer_reset(timer);
+    lv_timer_resume(timer);
+}
+
+// LVGL blocks still held after a popup call; zero once the screens it
+// touches are built. Needs the builtin LVGL allocator (reads 0 with clib).
+void DisplayManager::countPopupAllocs(const lv_mem_monitor_t & before) {
+    lv_mem_monitor_t after;
+    lv_mem_monitor(&after);
+    _popupCalls++;
+    _popupLastAllocs = after.used_cnt > before.used_cnt ? after.used_cnt - before.used_cnt : 0;
+    _popupAllocs += _popupLastAllocs;
+}
 
-    // Auto close after 5 seconds as requested
-    lv_timer_t * timer = lv_timer_create([](lv_timer_t * t){
-        lv_obj_t * obj = (lv_obj_t *)lv_timer_get_user_data(t);
-        if (obj) lv_obj_delete(obj);
-    }, 5000, mbox);
-    lv_timer_set_repeat_count(timer, 1);
+void DisplayManager::uiShowWarning(const char * msg) {
+    lv_mem_monitor_t before;
+    lv_mem_monitor(&before);
+    Serial.printf("UI: Showing Warning: %s\n", msg);
+    strlcpy(_warningText, msg, sizeof(_warningText));
+    lv_label_set_text_static(_warningLabel, _warningText);
+    lv_obj_remove_flag(_warningBox, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_move_foreground(_warningBox);
+    restartTimer(_warningTimer); // Auto close after 5 seconds
+    countPopupAllocs(before);
 }
 
-void DisplayManager::setOperationMode(int mode) {
+void DisplayManager::uiSetOperationMode(int mode) {
     _opMode = mode;
+    updatePricing(); // No promo in fixed mode
     if (!lbl_unit_price || !btnm || !cont_amount || !btn_gen) return;
     
     char buf[64];
-    if (_opMode == 0) {
-        sprintf(buf, "Valor Minuto: $%.2f", _pricePerUnit);
-    } else {
-        sprintf(buf, "Valor Credito: $%.2f", _pricePerUnit); // FIXED ENCODING (Credits)
-    }
+    int len = snprintf(buf, sizeof(buf), _opMode == 0 ? "Valor Minuto: $" : "Valor Credito: $"); // FIXED ENCODING (Credits)
+    PriceRules::format(buf + len, sizeof(buf) - len, _pricing.unitCentavos());
     lv_label_set_text(lbl_unit_price, buf);
 
     // Toggle UI Elements based on Mode
@@ -673,12 +915,13 @@ void DisplayManager::setOperationMode(int mode) {
     lv_label_set_text(lbl_amount, currentAmountStr.c_str());
 }
 
-void DisplayManager::setPricePerUnit(float price) {
+void DisplayManager::uiSetPricePerUnit(float price) {
     _pricePerUnit = price;
-    setOperationMode(_opMode); // Refresh label
+    uiSetOperationMode(_opMode); // Refresh label
 }
 
-void DisplayManager::setWiFiStatus(bool connected) {
+void DisplayManager::uiSetWiFiStatus(bool connected) {
+    _wifiConnected = connected;
     if (!lbl_wifi_status) return;
     if (connected) {
         lv_obj_set_style_bg_color(lbl_wifi_status, lv_palette_main(LV_PALETTE_GREEN), 0);
@@ -687,41 +930,19 @@ void DisplayManager::setWiFiStatus(bool connected) {
     }
 }
 
-void DisplayManager::setPromoConfig(bool enabled, int threshold, int type, float value) {
-    _promoEnabled = enabled;
-    _promoThreshold = threshold;
-    _promoType = type;
-    _promoValue = value;
-}
-
-void DisplayManager::setFixedModeConfig(int units) {
+void DisplayManager::uiSetFixedModeConfig(int units) {
     _fixedUnits = units;
     if (_opMode == 2) {
         // Force update to fixed amount
         currentAmountStr = String(_fixedUnits);
         if(lbl_amount) lv_label_set_text(lbl_amount, currentAmountStr.c_str());
-        
-        // Trigger calculation updates (price display)
-        lv_obj_send_event(lbl_amount, LV_EVENT_VALUE_CHANGED, NULL); // Hacky, better call handler logic directly or split it
-        // Since we can't easily emit event to handler without obj, we replicate logic:
-        float total = _fixedUnits * _pricePerUnit;
-        
-        // Apply Promotion Logic to Display
-        if (_promoEnabled && _fixedUnits >= _promoThreshold) {
-            float discountFactor = (100.0 - _promoValue) / 100.0;
-            total = total * discountFactor;
-            Serial.println("DisplayManager: Showing discounted price in Fixed Mode");
-        }
-
-        char buf[32];
-        sprintf(buf, "Total: $%.2f", total);
-        if(lbl_price_display) lv_label_set_text(lbl_price_display, buf);
+        updateKeypadTotal(_fixedUnits); // Fixed mode: never discounted
     }
 }
 
-void DisplayManager::setStaticQrText(String text) {
+void DisplayManager::uiSetStaticQrText(const char * text) {
     _staticQrText = text;
-    Serial.println("DisplayManager: setStaticQrText called with: '" + text + "'");
+    Serial.println("DisplayManager: setStaticQrText called with: '" + _staticQrText + "'");
     // Update the label if it exists
     if (lbl_static_qr_text) {
         if (_staticQrText.length() > 0) {
@@ -743,90 +964,320 @@ void DisplayManager::setStaticQrText(String text) {
 }
 
 
-void DisplayManager::showSuccess() {
+void DisplayManager::uiShowSuccess() {
     Serial.println("UI: Showing Success Screen...");
-    lv_screen_load(scr_success);
-    
-    lv_timer_t * timer = lv_timer_create([](lv_timer_t * t){
-        if (instance) {
-            lv_screen_load(instance->scr_keypad);
-            instance->currentAmountStr = "0";
-            lv_label_set_text(instance->lbl_amount, "0");
-            lv_label_set_text(instance->lbl_price_display, "Total: $0.00");
+    loadScreen(successScreen());
+    restartTimer(_successTimer); // Back to the keypad after 10 s
+}
+
+// Owns LVGL: runs its timers, then sleeps until the next one is due or a
+// command arrives, whichever comes first
+void DisplayManager::uiTaskEntry(void * arg) {
+    DisplayManager * self = (DisplayManager *)arg;
+    UiCommand cmd;
+    for (;;) {
+        uint32_t wait = lv_timer_handler();
+        self->updatePerf();
+
+        if (self->_showingInfo && (millis() - self->_infoStartTime > 30000)) {
+            self->uiShowKeypad();
         }
-    }, 10000, NULL);
-    lv_timer_set_repeat_count(timer, 1);
+        if (!self->_isShowingAds && (millis() - self->_lastActivity > 60000)) {
+            self->uiShowAds();
+        }
+
+        if (wait > UI_FRAME_MS) wait = UI_FRAME_MS;
+        if (wait < 1) wait = 1; // Let the loop task run on this core
+        if (xQueueReceive(self->_uiQueue, &cmd, pdMS_TO_TICKS(wait)) == pdTRUE) {
+            do {
+                self->runCommand(cmd);
+            } while (xQueueReceive(self->_uiQueue, &cmd, 0) == pdTRUE);
+        }
+    }
+}
+
+void DisplayManager::runCommand(const UiCommand & cmd) {
+    switch (cmd.type) {
+    case UI_SHOW_STARTUP: uiShowStartup(cmd.text); break;
+    case UI_SHOW_INFO:
+        uiShowInfo(cmd.text);
+        if (cmd.a) {
+            _showingInfo = true;
+            _infoStartTime = millis();
+        }
+        break;
+    case UI_SHOW_KEYPAD: uiShowKeypad(); break;
+    case UI_SHOW_QR: uiShowQR(cmd.text, cmd.f); break;
+    case UI_SHOW_READY: uiShowReady(); break;
+    case UI_SHOW_SUCCESS: uiShowSuccess(); break;
+    case UI_SET_ERROR: uiSetError(cmd.text); break;
+    case UI_SHOW_WARNING: uiShowWarning(cmd.text); break;
+    case UI_SHOW_ADS: uiShowAds(); break;
+    case UI_STOP_ADS: uiStopAds(); break;
+    case UI_SET_PRICE: uiSetPricePerUnit(cmd.f); break;
+    case UI_SET_MODE: uiSetOperationMode(cmd.a); break;
+    case UI_SET_PROMO:
+        _promoEnabled = cmd.a;
+        _promoThreshold = cmd.b;
+        _promoType = cmd.c;
+        _promoValue = cmd.f;
+        updatePricing();
+        break;
+    case UI_SET_FIXED: uiSetFixedModeConfig(cmd.a); break;
+    case UI_SET_STATIC_QR_TEXT: uiSetStaticQrText(cmd.text); break;
+    case UI_SET_WIFI: uiSetWiFiStatus(cmd.a); break;
+    case UI_SET_PERF_OVERLAY: uiSetPerfOverlay(cmd.a); break;
+    case UI_TOUCH:
+        // Read now instead of at the next indev poll, and render right after
+        lv_indev_read(_indev);
+        lv_timer_ready(lv_display_get_refr_timer(lv_display_get_default()));
+        break;
+    case UI_CAPTURE:
+        // Flush what is pending, then keep the canvas still while the web
+        // task reads it
+        if (!_captureWanted) break;
+        lv_refr_now(NULL);
+        xSemaphoreTake(_captureRelease, 0);
+        xSemaphoreGive(_captureDone);
+        xSemaphoreTake(_captureRelease, pdMS_TO_TICKS(UI_CAPTURE_HOLD_MS));
+        break;
+    }
+}
+
+void DisplayManager::post(UiCommandType type, const char * text, int32_t a, int32_t b, int32_t c, float f) {
+    if (!_uiQueue) return;
+    UiCommand cmd;
+    cmd.type = type;
+    cmd.a = a;
+    cmd.b = b;
+    cmd.c = c;
+    cmd.f = f;
+    cmd.text[0] = 0;
+    if (text && strlcpy(cmd.text, text, sizeof(cmd.text)) >= sizeof(cmd.text)) {
+        Serial.printf("UI: Command %d text truncated to %d chars\n", type, UI_TEXT_MAX - 1);
+    }
+    // Only blocks if the UI task is stuck; a dropped command is logged
+    if (xQueueSend(_uiQueue, &cmd, pdMS_TO_TICKS(100)) != pdTRUE) {
+        _uiQueueDropped++;
+        Serial.printf("UI: Queue full, dropped command %d\n", type);
+        return;
+    }
+    uint32_t depth = uxQueueMessagesWaiting(_uiQueue);
+    if (depth > _uiQueuePeak) _uiQueuePeak = depth;
+}
+
+void DisplayManager::postEvent(UiEventType type, int32_t arg) {
+    UiEvent ev = {type, arg};
+    if (xQueueSend(_eventQueue, &ev, 0) != pdTRUE) Serial.printf("UI: Event queue full, dropped %d\n", type);
 }
 
 void DisplayManager::loop() {
-    static unsigned long lastTick = 0;
-    if (millis() - lastTick >= 5) {
-        lv_tick_inc(millis() - lastTick);
-        lastTick = millis();
+    UiEvent ev;
+    while (_eventQueue && xQueueReceive(_eventQueue, &ev, 0) == pdTRUE) {
+        switch (ev.type) {
+        case UI_EVENT_PAYMENT:
+            if (_paymentCallback) _paymentCallback(ev.arg);
+            break;
+        case UI_EVENT_ACTIVATE:
+            if (_activationCallback) _activationCallback();
+            break;
+        case UI_EVENT_CANCEL:
+            if (_cancelCallback) _cancelCallback();
+            break;
+        case UI_EVENT_QR_SOUND:
+            if (_soundManager) ((SoundManager*)_soundManager)->playQrGenerated();
+            break;
+        }
     }
-    lv_timer_handler();
 
-    if (_showingInfo && (millis() - _infoStartTime > 30000)) {
-        showKeypad();
+    if (_adManifest && (!_playlistValid || _adManifest->generation() != _playlistGeneration)) {
+        buildPlaylist();
     }
+}
+
+void DisplayManager::showStartup(const char * msg) { post(UI_SHOW_STARTUP, msg); }
+
+void DisplayManager::showAPInfo(const char * ssid, const char * pass, const char * url) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "MODO CONFIGURACION\n\nConectar a Wifi:\n%s\n\nPanel Admin:\n%s", ssid, url);
+    post(UI_SHOW_INFO, buf);
+}
+
+void DisplayManager::showConnectionSuccess(const char * ip, const char * url) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "CONECTADO EXITOSAMENTE\n\nIP: %s\n\nURL: %s\n\nIniciando teclado...", ip, url);
+    post(UI_SHOW_INFO, buf, 1);
+}
 
-    if (!_isShowingAds && (millis() - _lastActivity > 60000)) {
-        showAds();
+void DisplayManager::showKeypad() { post(UI_SHOW_KEYPAD); }
+
+void DisplayManager::showQR(const char * url, float amount) {
+    if (_soundManager) ((SoundManager*)_soundManager)->playClick(); // Feedback for QR Ready
+    size_t len = strlen(url);
+    if (len >= UI_TEXT_MAX) {
+        Serial.printf("showQR: URL too long (%u)\n", len);
+        post(UI_SET_ERROR, "Error: URL too long");
+        return;
     }
+    post(UI_SHOW_QR, url, 0, 0, 0, amount);
 }
 
+void DisplayManager::showReady() { post(UI_SHOW_READY); }
+void DisplayManager::showSuccess() { post(UI_SHOW_SUCCESS); }
+void DisplayManager::setError(const char * msg) { post(UI_SET_ERROR, msg); }
+void DisplayManager::showWarning(const char * msg) { post(UI_SHOW_WARNING, msg); }
+void DisplayManager::showAds() { post(UI_SHOW_ADS); }
+void DisplayManager::stopAds() { post(UI_STOP_ADS); }
+
+// Called every loop pass while a service runs: only queues when there are
+// ads to take down
 void DisplayManager::addActivity() {
     _lastActivity = millis();
-    if (_isShowingAds) stopAds();
+    if (_isShowingAds) post(UI_STOP_ADS);
 }
 
-bool DisplayManager::tft_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t* bitmap) {
-    if (instance == nullptr || instance->_ad_buffer == nullptr) return false;
-    
-    // Copy block to our PSRAM buffer
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            int targetX = x + i;
-            int targetY = y + j;
-            if (targetX < 480 && targetY < 320) {
-                uint16_t color = bitmap[j * w + i];
-                // Byte swap was causing color issues
-                // color = (color >> 8) | (color << 8);
-                instance->_ad_buffer[targetY * 480 + targetX] = color;
+void DisplayManager::uiAddActivity() {
+    _lastActivity = millis();
+    if (_isShowingAds) uiStopAds();
+}
+
+void DisplayManager::setPricePerUnit(float price) { post(UI_SET_PRICE, nullptr, 0, 0, 0, price); }
+void DisplayManager::setOperationMode(int mode) { post(UI_SET_MODE, nullptr, mode); }
+
+void DisplayManager::setPromoConfig(bool enabled, int threshold, int type, float value) {
+    post(UI_SET_PROMO, nullptr, enabled, threshold, type, value);
+}
+
+void DisplayManager::setFixedModeConfig(int units) { post(UI_SET_FIXED, nullptr, units); }
+void DisplayManager::setStaticQrText(const char * text) { post(UI_SET_STATIC_QR_TEXT, text); }
+void DisplayManager::setWiFiStatus(bool connected) { post(UI_SET_WIFI, nullptr, connected); }
+void DisplayManager::setPerfOverlay(bool visible) { post(UI_SET_PERF_OVERLAY, nullptr, visible); }
+
+// Screen switch timing: from the load until its last area is on the panel.
+// The QR canvas buffer only lives while its screen is up.
+void DisplayManager::loadScreen(lv_obj_t * scr) {
+    _transitionAt = micros();
+    lv_screen_load(scr);
+    if (scr != scr_qr && qr_buffer) {
+        memoryManager.free(MEM_QR, qr_buffer);
+        qr_buffer = nullptr;
+    }
+}
+
+// Builds a screen the first time it is needed
+lv_obj_t * DisplayManager::ensureScreen(lv_obj_t *& scr, void (DisplayManager::*create)(), const char * name) {
+    if (!scr) {
+        unsigned long t0 = micros();
+        (this->*create)();
+        Serial.printf("UI: Built %s screen in %lu us\n", name, micros() - t0);
+    }
+    return scr;
+}
+
+bool DisplayManager::injectTouch(int x, int y, uint16_t ms) {
+    if (_injectUntil || x < 0 || y < 0 || x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT) return false;
+    _injectX = x;
+    _injectY = y;
+    _injectUntil = millis() + (ms < 30 ? 30 : ms); // At least a few indev reads
+    return true;
+}
+
+bool DisplayManager::captureScreen(uint32_t timeoutMs) {
+    if (!canvas) return false;
+    xSemaphoreTake(_captureDone, 0);
+    _captureWanted = true;
+    post(UI_CAPTURE);
+    if (xSemaphoreTake(_captureDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE) return true;
+    _captureWanted = false;
+    return false;
+}
+
+// The canvas is native portrait: logical (x, y) is fb[x * 320 + 319 - y]
+bool DisplayManager::writeCapturePng(Print & out) {
+    const uint16_t * fb = canvas->getFramebuffer();
+    return PngEncoder::write(out, fb + LCD_NATIVE_WIDTH - 1, DISPLAY_WIDTH, DISPLAY_HEIGHT, -1, LCD_NATIVE_WIDTH);
+}
+
+void DisplayManager::releaseCapture() {
+    _captureWanted = false;
+    xSemaphoreGive(_captureRelease);
+}
+
+// Builds the rotation order once per manifest change, from loop(). Order and
+// per-ad duration come from /ads/playlist.txt when present ("name[,seconds]"
+// per line, '#' comments); images it does not mention follow in manifest
+// order. The UI task adopts it in takePlaylist().
+void DisplayManager::buildPlaylist() {
+    unsigned long t0 = micros();
+    std::vector<AdPlaylistItem> playlist;
+    _playlistValid = true;
+    if (!_adManifest) return;
+    _playlistGeneration = _adManifest->generation();
+
+    std::vector<bool> used(_adManifest->count(), false);
+    auto isPlayable = [](const String & name) {
+        String low = name;
+        low.toLowerCase();
+        return low.endsWith(".jpg") || low.endsWith(".jpeg") || low.endsWith(".png") || low.endsWith(AD_RAW_EXT) ||
+               AdDecoder::isVideoPath(low.c_str());
+    };
+    auto add = [&](int idx, uint32_t durationMs) {
+        const AdEntry & e = _adManifest->at(idx);
+        playlist.push_back({"/ads/" + e.name, e.width, e.height, durationMs, e.mtime ^ e.size});
+        used[idx] = true;
+    };
+
+    if (_adManifest->indexOf(AD_PLAYLIST_FILE) >= 0) {
+        File f = SD.open("/ads/" AD_PLAYLIST_FILE, FILE_READ);
+        char line[96];
+        while (f && f.available()) {
+            size_t len = f.readBytesUntil('\n', line, sizeof(line) - 1);
+            line[len] = 0;
+            if (len > 0 && line[len - 1] == '\r') line[--len] = 0;
+            if (len == 0 || line[0] == '#') continue;
+
+            uint32_t durationMs = AD_DEFAULT_DURATION_MS;
+            char * comma = strchr(line, ',');
+            if (comma) {
+                *comma = 0;
+                int secs = atoi(comma + 1);
+                if (secs > 0) durationMs = secs * 1000;
             }
+            int idx = _adManifest->indexOf(line);
+            if (idx >= 0 && isPlayable(line)) add(idx, durationMs);
         }
+        if (f) f.close();
     }
+
+    for (size_t i = 0; i < _adManifest->count(); i++) {
+        if (!used[i] && isPlayable(_adManifest->at(i).name)) add(i, AD_DEFAULT_DURATION_MS);
+    }
+
+    Serial.printf("ADS: Playlist rebuilt: %u items in %lu us\n", playlist.size(), micros() - t0);
+
+    xSemaphoreTake(_playlistLock, portMAX_DELAY);
+    _pendingPlaylist.swap(playlist);
+    _playlistPending = true;
+    xSemaphoreGive(_playlistLock);
+}
+
+bool DisplayManager::takePlaylist() {
+    if (!_playlistPending) return false;
+    xSemaphoreTake(_playlistLock, portMAX_DELAY);
+    _playlist.swap(_pendingPlaylist);
+    _pendingPlaylist.clear();
+    _playlistPending = false;
+    xSemaphoreGive(_playlistLock);
     return true;
 }
 
-void DisplayManager::showAds() {
+void DisplayManager::uiShowAds() {
     if (_isShowingAds) return;
     
     Serial.println("ADS: Triggering Advertising Carousel...");
     
-    // Check if there are images in /ads
-    File root = SD.open("/ads");
-    if (!root || !root.isDirectory()) {
-        Serial.println("ADS ERROR: /ads directory not found on SD!");
-        _lastActivity = millis(); 
-        return;
-    }
-    
-    // Quick check for at least one file
-    bool hasFiles = false;
-    File f = root.openNextFile();
-    while(f) {
-        if(!f.isDirectory()) {
-            hasFiles = true;
-            f.close();
-            break;
-        }
-        f.close();
-        f = root.openNextFile();
-    }
-    root.close();
-
-    if (!hasFiles) {
+    takePlaylist();
+    if (_playlist.empty()) {
         Serial.println("ADS: No files found in /ads directory.");
         _lastActivity = millis();
         return;
@@ -834,81 +1285,127 @@ void DisplayManager::showAds() {
 
     _isShowingAds = true;
     _currentAdIndex = 0;
-    lv_screen_load(scr_ads);
+    loadScreen(adsScreen());
     Serial.println("ADS: Screen loaded.");
+
     
-    // Create timer for rotation
+    // Create timer for rotation; period follows each item's duration
     _adTimer = lv_timer_create([](lv_timer_t * t){
-        instance->_isShowingAds = true; 
-        
-        File root = SD.open("/ads");
-        if(!root) {
-             Serial.println("ADS: Failed to open /ads for rotation.");
-             return;
-        }
+        instance->rotateAd();
+    }, AD_DEFAULT_DURATION_MS, NULL);
+    lv_timer_ready(_adTimer); // Trigger first one immediately
+}
 
-        int count = 0;
-        File file = root.openNextFile();
-        String targetFile = "";
-        
-        // Find next image based on index
-        while (file) {
-            String fname = String(file.name());
-            
-            // Fix path construction: if name starts with /, don't add another /
-            String fullPath;
-            if (fname.startsWith("/")) fullPath = "/ads" + fname; // Usually not the case
-            else fullPath = "/ads/" + fname;
-             
-            // Some SD libraries return full path " /ads/image.jpg", others just "image.jpg"
-            // Let's normalize. If fname contains "ads", assume full path.
-            if(fname.indexOf("ads/") >= 0) fullPath = fname;
-            if(!fullPath.startsWith("/")) fullPath = "/" + fullPath;
-
-            String lowName = fullPath;
-            lowName.toLowerCase();
-            
-            if (!file.isDirectory() && (lowName.endsWith(".jpg") || lowName.endsWith(".jpeg"))) {
-                if (count == instance->_currentAdIndex) {
-                    targetFile = fullPath;
-                }
-                count++;
-            }
-            file.close(); // IMPORTANT: Close handle
-            file = root.openNextFile();
+// Runs in the LVGL timer. Decoding happens on the other core (AdDecoder),
+// so this only swaps buffers and queues the next ad.
+void DisplayManager::rotateAd() {
+    _isShowingAds = true;
+
+    if (_adVideoActive) {
+        // Video on screen: show each frame the decoder publishes
+        if (_adDecoder.isReady()) {
+            presentAdFrame();
+            return;
         }
-        root.close(); // IMPORTANT: Close directory handle
-        
-        if (targetFile != "" && count > 0) {
-            uint16_t jpgW = 0, jpgH = 0;
-            TJpgDec.getSdJpgSize(&jpgW, &jpgH, targetFile.c_str());
-            Serial.printf("ADS: Decoding [%d/%d]: %s (%dx%d)\n", instance->_currentAdIndex + 1, count, targetFile.c_str(), jpgW, jpgH);
-            
-            if (jpgW > 0 && jpgH > 0) {
-                // Clear buffer to black before decoding new image
-                memset(instance->_ad_buffer, 0, 480 * 320 * sizeof(uint16_t));
-    
-                // Decode directly from SD into _ad_buffer via tft_output callback
-                TJpgDec.drawSdJpg(0, 0, targetFile.c_str());
-            } else {
-                Serial.println("ADS: Failed to get JPG size or invalid image.");
-            }
-            
-            // Refresh image source
-            lv_image_set_src(instance->img_ad, &instance->_ad_img_dsc);
-            lv_obj_invalidate(instance->img_ad);
-            
-            instance->_currentAdIndex = (instance->_currentAdIndex + 1) % count;
-        } else {
-            Serial.println("ADS: No valid target file found or index out of bounds.");
-            instance->_currentAdIndex = 0;
+        if (_adDecoder.isVideoPlaying()) return;
+        _adVideoActive = false; // Finished: continue with the next item
+        lv_timer_set_period(_adTimer, 50);
+    }
+
+    // Ads uploaded/deleted while the carousel runs: pick up the new list
+    if (takePlaylist()) _currentAdIndex = 0;
+    if (_playlist.empty()) {
+        Serial.println("ADS: No valid target file found or index out of bounds.");
+        _currentAdIndex = 0;
+        return;
+    }
+    if (_currentAdIndex >= (int)_playlist.size()) _currentAdIndex = 0;
+
+    auto readyForCurrent = [this]() {
+        return _adDecoder.isReady() && _adDecoder.readyTag() == _currentAdIndex;
+    };
+    if (!readyForCurrent()) {
+        // First ad, cache released or decoder still behind: request it
+        // (a cache hit is ready immediately) and otherwise poll shortly
+        const AdPlaylistItem & want = _playlist[_currentAdIndex];
+        if (!_adDecoder.isBusy()) _adDecoder.request(want.path.c_str(), want.stamp, _currentAdIndex);
+        if (!readyForCurrent()) {
+            lv_timer_set_period(_adTimer, 50);
+            return;
         }
-    }, 10000, NULL); // 10s per ad
-    lv_timer_ready(_adTimer); // Trigger first one immediately
+    }
+
+    unsigned long t0 = micros();
+    const AdPlaylistItem & item = _playlist[_currentAdIndex];
+
+    presentAdFrame();
+
+    if (AdDecoder::isVideoPath(item.path.c_str())) {
+        // First frame is up; the decoder keeps feeding the rest
+        _adVideoActive = true;
+        _currentAdIndex = (_currentAdIndex + 1) % _playlist.size();
+        lv_timer_set_period(_adTimer, AD_VIDEO_TICK_MS);
+        Serial.printf("ADS: Playing video %s\n", item.path.c_str());
+        return;
+    }
+    lv_timer_set_period(_adTimer, item.durationMs);
+
+    // Prefetch the next ad while this one is on screen (no-op on cache hit)
+    _currentAdIndex = (_currentAdIndex + 1) % _playlist.size();
+    const AdPlaylistItem & next = _playlist[_currentAdIndex];
+    _adDecoder.request(next.path.c_str(), next.stamp, _currentAdIndex);
+
+    const AdDecoder::Stats & st = _adDecoder.getStats();
+    Serial.printf("ADS: Showing %s (%dx%d). Loop stall %lu us, last decode %u ms, cache %u/%u hits, %u KB\n",
+                  item.path.c_str(), item.width, item.height, micros() - t0, st.lastDecodeMs,
+                  st.hits, st.hits + st.misses, _adDecoder.residentBytes() / 1024);
+}
+
+void DisplayManager::presentAdFrame() {
+    _ad_buffer = _adDecoder.swap();
+    _ad_img_dsc.data = (const uint8_t *)_ad_buffer;
+    lv_image_set_src(img_ad, &_ad_img_dsc);
+    lv_obj_invalidate(img_ad);
+}
+
+bool DisplayManager::requestAdThumbnail(const String & name) {
+    if (!SD.exists(AD_THUMB_DIR)) SD.mkdir(AD_THUMB_DIR);
+    return _adDecoder.requestThumbnail(("/ads/" + name).c_str(), AdManifest::thumbnailPath(name).c_str());
+}
+
+// Gives the cached ad frames back to PSRAM for the QR/payment screens
+void DisplayManager::releaseAdMemory() {
+    if (_isShowingAds) return;
+    _adDecoder.releaseMemory(false);
+    _ad_buffer = nullptr;
+    _ad_img_dsc.data = nullptr;
+    if (img_ad) lv_image_set_src(img_ad, NULL);
+}
+
+String DisplayManager::getAdCacheJson() {
+    const AdDecoder::Stats & st = _adDecoder.getStats();
+    uint32_t lookups = st.hits + st.misses;
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"hits\":%u,\"misses\":%u,\"hitRate\":%.3f,\"residentBytes\":%u,"
+             "\"decodes\":%u,\"lastDecodeMs\":%u,\"maxDecodeMs\":%u,\"avgDecodeMs\":%u,"
+             "\"jpeg\":{\"count\":%u,\"avgMs\":%u},\"png\":{\"count\":%u,\"avgMs\":%u},"
+             "\"raw\":{\"count\":%u,\"avgMs\":%u},"
+             "\"video\":{\"frames\":%u,\"dropped\":%u,\"avgMs\":%u}}",
+             st.hits, st.misses, lookups ? (float)st.hits / lookups : 0.0f,
+             (unsigned)_adDecoder.residentBytes(), st.decodes, st.lastDecodeMs, st.maxDecodeMs,
+             st.decodes ? st.totalDecodeMs / st.decodes : 0,
+             st.jpegDecodes, st.jpegDecodes ? st.jpegTotalMs / st.jpegDecodes : 0,
+             st.pngDecodes, st.pngDecodes ? st.pngTotalMs / st.pngDecodes : 0,
+             st.rawLoads, st.rawLoads ? st.rawTotalMs / st.rawLoads : 0,
+             st.videoFrames, st.videoDropped, st.videoFrames ? st.videoTotalMs / st.videoFrames : 0);
+    return String(buf);
 }
 
-void DisplayManager::stopAds() {
+void DisplayManager::uiStopAds() {
     _isShowingAds = false;
+    _adVideoActive = false;
+    _adDecoder.cancel(); // Video stops after the current frame; nothing stale stays ready
     if (_adTimer) {
         lv_timer_delete(_adTimer);
         _adTimer = nullptr;
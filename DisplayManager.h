@@ -5,7 +5,12 @@
 #include <Arduino_GFX_Library.h>
 #include <lvgl.h>
 #include "AXS15231B_touch.h"
+#include "AdDecoder.h"
+#include "PerfHistogram.h"
+#include "AdManifest.h"
+#include "Pricing.h"
 #include <TJpg_Decoder.h>
+#include <vector>
 
 // Colores base
 #define C_BLACK 0x0000
@@ -13,11 +18,108 @@
 #define C_BLUE  0x001F
 #define C_GREEN 0x07E0
 
+#define DISPLAY_WIDTH 480  // Logical, landscape
+#define DISPLAY_HEIGHT 320
+#define LCD_NATIVE_WIDTH 320 // Panel is portrait
+
+// 1: expose /api/ui/screenshot and /api/ui/touch for ui_regress.py. Test
+// builds only; a kiosk must not take remote taps.
+// Test build, e.g.:
+//   arduino-cli compile --fqbn esp32:esp32:esp32s3:PSRAM=opi \
+//     --build-property "compiler.cpp.extra_flags=-DUI_TEST_HOOKS=1"
+#ifndef UI_TEST_HOOKS
+#define UI_TEST_HOOKS 0
+#endif
+#define UI_CAPTURE_HOLD_MS 5000 // Longest the UI stays frozen for a screenshot
+// LVGL draw buffer, 1/10 of the screen. Sized for RGB565 output: v9's
+// lv_color_t is 3 bytes and would overstate it by half.
+#define DISPLAY_DRAW_BUF_PIXELS (DISPLAY_WIDTH * DISPLAY_HEIGHT / 10)
+#define DISPLAY_DRAW_BUF_BYTES (DISPLAY_DRAW_BUF_PIXELS * 2)
+
+#define AD_DEFAULT_DURATION_MS 10000
+#define AD_PLAYLIST_FILE "playlist.txt" // Optional, inside /ads: "name[,seconds]" per line
+#define AD_VIDEO_TICK_MS 10 // Frame poll period while a video ad plays (runs to its end)
+
+// LVGL runs in its own task; every other task talks to it through a queue
+#define UI_TASK_STACK 8192
+#define UI_TASK_PRIORITY 2 // Above the Arduino loop (1) on the same core
+#define UI_QUEUE_LEN 16
+#define UI_EVENT_QUEUE_LEN 8
+#define UI_TEXT_MAX 320    // Longest string a command carries (QR URLs)
+#define UI_FRAME_MS 33     // Longest the task sleeps between timer runs
+
+// Touch: the interrupt wakes a task on core 0 that does the I2C read and
+// queues the point; the UI task is woken to hand it to LVGL at once
+#define TOUCH_TASK_PRIORITY 3
+#define TOUCH_RING_SIZE 16  // Power of two
+#define TOUCH_RELEASE_MS 40 // No interrupt for this long: finger lifted
+
+enum UiCommandType : uint8_t {
+  UI_SHOW_STARTUP,
+  UI_SHOW_INFO,    // Startup screen, small font; a: back to the keypad after 30 s
+  UI_SHOW_KEYPAD,
+  UI_SHOW_QR,
+  UI_SHOW_READY,
+  UI_SHOW_SUCCESS,
+  UI_SET_ERROR,
+  UI_SHOW_WARNING,
+  UI_SHOW_ADS,
+  UI_STOP_ADS,
+  UI_SET_PRICE,
+  UI_SET_MODE,
+  UI_SET_PROMO,
+  UI_SET_FIXED,
+  UI_SET_STATIC_QR_TEXT,
+  UI_SET_WIFI,
+  UI_SET_PERF_OVERLAY,
+  UI_CAPTURE,
+  UI_TOUCH,        // New touch samples queued: read the indev now
+};
+
+// Copied by value into the queue, so no String crosses tasks
+struct UiCommand {
+  UiCommandType type;
+  int32_t a, b, c;
+  float f;
+  char text[UI_TEXT_MAX];
+};
+
+// What the UI task hands back to the Arduino loop
+enum UiEventType : uint8_t {
+  UI_EVENT_PAYMENT,  // arg: units
+  UI_EVENT_ACTIVATE,
+  UI_EVENT_CANCEL,
+  UI_EVENT_QR_SOUND,
+};
+
+struct UiEvent {
+  UiEventType type;
+  int32_t arg;
+};
+
+struct TouchSample {
+  int16_t x, y;
+  bool pressed;
+  uint32_t irqUs; // micros() of the interrupt that produced it
+};
+
+struct AdPlaylistItem {
+  String path;
+  uint16_t width;
+  uint16_t height;
+  uint32_t durationMs;
+  uint32_t stamp; // mtime ^ size, invalidates cached frames on re-upload
+};
+
+// All LVGL work happens on a dedicated task (core 1, above the Arduino
+// loop). The public methods below only queue a command and return, so they
+// are safe from any task; button callbacks and UI sounds come back through
+// an event queue and run from loop(), in the caller's context.
 class DisplayManager {
 public:
   DisplayManager();
   void begin();
-  void loop();
+  void loop(); // Runs the queued UI events and rebuilds the ad playlist
   
   typedef void (*PaymentRequestCallback)(int units);
   void setPaymentCallback(PaymentRequestCallback cb) { _paymentCallback = cb; }
@@ -26,15 +128,16 @@ public:
   void setActivationCallback(ActivationCallback cb) { _activationCallback = cb; }
   void setCancelCallback(ActivationCallback cb) { _cancelCallback = cb; }
 
-  void showStartup(String msg);
-  void showAPInfo(String ssid, String pass, String url);
-  void showConnectionSuccess(String ip, String url);
+  // Strings are copied into the command, so temporaries are fine
+  void showStartup(const char * msg);
+  void showAPInfo(const char * ssid, const char * pass, const char * url);
+  void showConnectionSuccess(const char * ip, const char * url);
   void showKeypad();
-  void showQR(String url, float amount);
+  void showQR(const char * url, float amount);
   void showReady();
   void showSuccess();
-  void setError(String msg);
-  void showWarning(String msg);
+  void setError(const char * msg);
+  void showWarning(const char * msg);
   void showAds();
   void stopAds();
   void addActivity();
@@ -43,46 +146,65 @@ public:
   void setOperationMode(int mode);
   void setPromoConfig(bool enabled, int threshold, int type, float value);
   void setFixedModeConfig(int units);
-  void setStaticQrText(String text);
+  void setStaticQrText(const char * text);
   void setWiFiStatus(bool connected);
   void setSoundManager(void * mgr) { _soundManager = mgr; }
+  void setAdManifest(AdManifest * manifest) { _adManifest = manifest; }
+  bool requestAdThumbnail(const String & name);
+  String getAdCacheJson();
+  // Render/flush histograms and FPS; the overlay shows them on screen
+  String getPerfJson();
+  void setPerfOverlay(bool visible);
+
+  // UI regression hooks (/api/ui/*). captureScreen() renders what is pending
+  // and freezes the UI task, so the canvas framebuffer holds the frame on
+  // the panel; writeCapturePng() streams it and releaseCapture() resumes
+  // the UI (which also resumes by itself after UI_CAPTURE_HOLD_MS).
+  bool captureScreen(uint32_t timeoutMs = 2000);
+  bool writeCapturePng(Print & out);
+  void releaseCapture();
+  // Presses (x, y) in logical coordinates for `ms`, as if touched
+  bool injectTouch(int x, int y, uint16_t ms = 100);
 
 private:
   Arduino_DataBus *bus;
   Arduino_GFX *gfx;
-  Arduino_Canvas *canvas;
+  Arduino_Canvas *canvas = nullptr;
   AXS15231B_Touch *touch;
 
-  // OBJETOS LVGL
-  lv_obj_t * scr_startup;
-  lv_obj_t * scr_keypad;
-  lv_obj_t * scr_qr;
-  lv_obj_t * scr_ready;
-  lv_obj_t * scr_success;
-  lv_obj_t * scr_ads;
+  // OBJETOS LVGL. Only the startup screen exists after begin(); the others
+  // are built the first time they are shown (keypadScreen() etc.)
+  lv_obj_t * scr_startup = nullptr;
+  lv_obj_t * scr_keypad = nullptr;
+  lv_obj_t * scr_qr = nullptr;
+  lv_obj_t * scr_ready = nullptr;
+  lv_obj_t * scr_success = nullptr;
+  lv_obj_t * scr_ads = nullptr;
   
-  lv_obj_t * img_ad;
+  lv_obj_t * img_ad = nullptr;
   
-  lv_obj_t * lbl_status; // For startup/AP info
+  lv_obj_t * lbl_status = nullptr; // For startup/AP info
   
   // UI Elements
-  lv_obj_t * cont_amount;
-  lv_obj_t * btnm;
-  lv_obj_t * btn_gen;
-
-  lv_obj_t * lbl_amount;
-  lv_obj_t * lbl_total;
-  lv_obj_t * lbl_price_display; // Total $ label on keypad
-  lv_obj_t * lbl_unit_price;    // "Valor Minuto/Credito" label
-  lv_obj_t * lbl_promo_info;    // "10% OFF" label
-  lv_obj_t * lbl_wifi_status;   // "Offline" warning
-  lv_obj_t * qr_canvas;
+  lv_obj_t * cont_amount = nullptr;
+  lv_obj_t * btnm = nullptr;
+  lv_obj_t * btn_gen = nullptr;
+
+  lv_obj_t * lbl_amount = nullptr;
+  lv_obj_t * lbl_total = nullptr;
+  lv_obj_t * lbl_price_display = nullptr; // Total $ label on keypad
+  lv_obj_t * lbl_unit_price = nullptr;    // "Valor Minuto/Credito" label
+  lv_obj_t * lbl_promo_info = nullptr;    // "10% OFF" label
+  lv_obj_t * lbl_wifi_status = nullptr;   // "Offline" warning
+  bool _wifiConnected = true;             // Applied when the keypad is built
+  lv_obj_t * qr_canvas = nullptr;
   lv_color_t * qr_buffer = nullptr;
   
   String currentAmountStr = "0";
   float unitPrice = 0; // This seems redundant with _pricePerUnit, I'll use _pricePerUnit
   float _pricePerUnit = 0;
   int _opMode = 0; // 0: Time, 1: Credit, 2: Fixed QR
+  PriceRules _pricing; // Rebuilt from the settings below by updatePricing()
   
   // Promo Settings
   bool _promoEnabled = false;
@@ -102,17 +224,139 @@ private:
   unsigned long _infoStartTime = 0;
   bool _showingInfo = false;
   
-  unsigned long _lastActivity = 0;
-  bool _isShowingAds = false;
+  volatile unsigned long _lastActivity = 0;
+  volatile bool _isShowingAds = false;
+
+  QueueHandle_t _uiQueue = nullptr;
+  QueueHandle_t _eventQueue = nullptr;
+  uint32_t _uiQueuePeak = 0, _uiQueueDropped = 0;
+  static void uiTaskEntry(void * arg);
+  void post(UiCommandType type, const char * text = nullptr, int32_t a = 0, int32_t b = 0, int32_t c = 0, float f = 0);
+  void postEvent(UiEventType type, int32_t arg = 0);
+  void runCommand(const UiCommand & cmd);
+  void loadScreen(lv_obj_t * scr);
+
+  // Popups: built once, then retexted/shown/hidden; the timers are reused
+  lv_obj_t * _warningBox = nullptr;
+  lv_obj_t * _warningLabel = nullptr;
+  char _warningText[UI_TEXT_MAX] = "";
+  char _errorText[64] = "";
+  lv_timer_t * _warningTimer = nullptr;
+  lv_timer_t * _errorTimer = nullptr;
+  lv_timer_t * _successTimer = nullptr;
+  uint32_t _popupCalls = 0, _popupAllocs = 0, _popupLastAllocs = 0;
+  void createPopups();
+  void restartTimer(lv_timer_t * timer);
+  void countPopupAllocs(const lv_mem_monitor_t & before);
+  lv_obj_t * ensureScreen(lv_obj_t *& scr, void (DisplayManager::*create)(), const char * name);
+  lv_obj_t * keypadScreen() { return ensureScreen(scr_keypad, &DisplayManager::createKeypadUI, "keypad"); }
+  lv_obj_t * qrScreen() { return ensureScreen(scr_qr, &DisplayManager::createQRUI, "qr"); }
+  lv_obj_t * readyScreen() { return ensureScreen(scr_ready, &DisplayManager::createReadyUI, "ready"); }
+  lv_obj_t * successScreen() { return ensureScreen(scr_success, &DisplayManager::createSuccessUI, "success"); }
+  lv_obj_t * adsScreen() { return ensureScreen(scr_ads, &DisplayManager::createAdsUI, "ads"); }
+
+  // Boot timing, ms (firstFrameMs and beginEndMs are since reset)
+  struct BootTiming {
+    unsigned long panelMs = 0;
+    unsigned long lvglMs = 0;
+    unsigned long beginMs = 0;
+    unsigned long beginEndMs = 0;
+    unsigned long firstFrameMs = 0;
+    bool logged = false;
+  };
+  BootTiming _boot;
+
+  volatile bool _captureWanted = false; // Cleared if captureScreen() gave up
+  SemaphoreHandle_t _captureDone = nullptr;
+  SemaphoreHandle_t _captureRelease = nullptr;
+  volatile unsigned long _injectUntil = 0;
+  volatile int16_t _injectX = 0, _injectY = 0;
+
+  // Touch ring: single producer (touch task), single consumer (UI task)
+  TouchSample _touchRing[TOUCH_RING_SIZE];
+  volatile uint8_t _touchHead = 0, _touchTail = 0;
+  volatile bool _touchWake = false; // UI_TOUCH posted and not yet handled
+  TouchSample _touchLast = {0, 0, false, 0};
+  volatile uint32_t _touchRenderFrom = 0; // Interrupt time of the oldest input not yet on screen
+  uint32_t _touchSamples = 0, _touchCoalesced = 0, _touchDropped = 0;
+  lv_indev_t * _indev = nullptr;
+  static void touchTaskEntry(void * arg);
+  bool pushTouch(const TouchSample & sample);
+  void readTouch(lv_indev_data_t * data);
+
+  // Implementations, UI task only
+  void uiShowStartup(const char * msg);
+  void uiShowInfo(const char * text);
+  void uiShowKeypad();
+  void uiShowQR(const char * url, float amount);
+  void uiShowReady();
+  void uiShowSuccess();
+  void uiSetError(const char * msg);
+  void uiShowWarning(const char * msg);
+  void uiShowAds();
+  void uiStopAds();
+  void uiAddActivity();
+  void uiSetPricePerUnit(float price);
+  void uiSetOperationMode(int mode);
+  void uiSetFixedModeConfig(int units);
+  void uiSetStaticQrText(const char * text);
+  void uiSetWiFiStatus(bool connected);
+  void uiSetPerfOverlay(bool visible);
   
   // Sound Hook
   void * _soundManager = nullptr;
 
+  AdManifest * _adManifest = nullptr;
   int _currentAdIndex = 0;
   lv_timer_t * _adTimer = nullptr;
+  std::vector<AdPlaylistItem> _playlist; // UI task's copy
+  // Built in loop() (the manifest is only safe to read there) and picked up
+  // by the UI task under _playlistLock
+  std::vector<AdPlaylistItem> _pendingPlaylist;
+  volatile bool _playlistPending = false;
+  SemaphoreHandle_t _playlistLock = nullptr;
+  uint32_t _playlistGeneration = 0; // Manifest generation the playlist was built from
+  bool _playlistValid = false;
+  bool _adVideoActive = false;
+  AdDecoder _adDecoder;
   
   lv_image_dsc_t _ad_img_dsc;
-  uint16_t * _ad_buffer = nullptr;
+  uint16_t * _ad_buffer = nullptr; // Front frame owned by _adDecoder
+
+  // Bus traffic since the last report
+  struct FlushStats {
+    uint32_t areas = 0;
+    uint32_t frames = 0;
+    uint32_t pixels = 0;
+    uint32_t busUs = 0;
+    unsigned long since = 0;
+  };
+  FlushStats _flushStats;
+
+  // Rolling histograms (decayed every 10 s)
+  PerfHistogram _perfRender;   // us, LVGL refresh start..ready
+  PerfHistogram _perfFlush;    // us on the bus per frame
+  PerfHistogram _perfBytes;    // bytes pushed per frame
+  PerfHistogram _perfInterval; // us between frames while the UI is changing
+  PerfHistogram _perfTouchRead;   // us, interrupt to point read over I2C
+  PerfHistogram _perfTouchIndev;  // us, interrupt to LVGL reading it
+  PerfHistogram _perfTouchRender; // us, interrupt to the resulting frame flushed
+  // Not decayed: screen switches are rare and a regression run reads them after
+  PerfHistogram _perfTransition; // us from loadScreen() to the last area flushed
+  PerfHistogram _perfQr;         // us to build and draw the QR
+  PerfHistogram _perfKeypad;     // us to reprice and relabel the keypad total per key
+  volatile unsigned long _transitionAt = 0;
+  volatile uint32_t _frameCount = 0;
+  uint32_t _frameBusUs = 0, _framePixels = 0;
+  unsigned long _lastFrameAt = 0, _refrStartedAt = 0;
+  uint32_t _fps = 0, _fpsFrames = 0;
+  unsigned long _fpsSince = 0, _perfDecayedAt = 0;
+  lv_obj_t * _perfOverlay = nullptr;
+  bool _perfOverlayVisible = false;
+  void onFlushed(uint32_t pixels, uint32_t busUs, bool last);
+  void updatePerf();
+
+  uint8_t * _drawBuf = nullptr;
 
   void initLVGL();
   void createStartupUI();
@@ -121,8 +365,14 @@ private:
   void createReadyUI();
   void createSuccessUI();
   void createAdsUI();
+  void updatePricing();
+  void updateKeypadTotal(int units);
+  void buildPlaylist();
+  bool takePlaylist();
+  void rotateAd();
+  void presentAdFrame();
+  void releaseAdMemory();
   
-  static bool tft_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t* bitmap);
   static void event_handler_num(lv_event_t * e);
   static void event_handler_gen(lv_event_t * e);
 };
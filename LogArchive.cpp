@@ -0,0 +1,203 @@
+#include "LogArchive.h"
+
+static size_t putVarint(uint8_t *p, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static void putU32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+String LogArchive::segmentPath(uint32_t day) {
+  return String(ARCHIVE_DIR "/") + String(day) + ".seg";
+}
+
+bool LogArchive::sealDay(fs::FS &srcFs, const char *srcPath, fs::FS &dstFs, uint32_t day,
+                         DaySummary &summary) {
+  memset(&summary, 0, sizeof(summary));
+  summary.day = day;
+
+  File src = srcFs.open(srcPath, "r");
+  if (!src) return false;
+  summary.rawBytes = src.size();
+  if (summary.rawBytes == 0) {
+    src.close();
+    return false;
+  }
+
+  if (!dstFs.exists(ARCHIVE_DIR)) dstFs.mkdir(ARCHIVE_DIR);
+  String path = segmentPath(day);
+  File seg = dstFs.open(path, "w");
+  if (!seg) {
+    src.close();
+    return false;
+  }
+
+  uint8_t header[16] = {'Q', 'R', 'S', 'G', ARCHIVE_VERSION, 0, 0, 0};
+  putU32(header + 8, day);
+  putU32(header + 12, 0); // Patched once the count is known
+  seg.write(header, sizeof(header));
+
+  uint32_t count = 0;
+  uint32_t prevTs = 0;
+  int32_t prevCents = 0;
+  uint64_t timeSeconds = 0; // Summed, converted once: per-row division truncates
+  char prevRef[48] = "";
+  char line[128];
+  uint8_t rec[128];
+
+  while (src.available()) {
+    size_t len = src.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[len] = 0;
+    if (len == 0) continue;
+
+    // amount,value,ref[,ts,mode] (older rows only have the first three)
+    char *fields[5] = {line, nullptr, nullptr, nullptr, nullptr};
+    int nf = 1;
+    for (char *c = line; *c && nf < 5; c++) {
+      if (*c == ',') {
+        *c = 0;
+        fields[nf++] = c + 1;
+      }
+    }
+    if (nf < 3) continue;
+
+    int32_t cents = (int32_t)lround(strtod(fields[0], nullptr) * 100.0);
+    uint32_t value = strtoul(fields[1], nullptr, 10);
+    const char *ref = fields[2];
+    uint32_t ts = nf > 3 ? strtoul(fields[3], nullptr, 10) : 0;
+    uint8_t mode = (nf > 4 && fields[4][0] == 'C') ? 1 : 0;
+
+    size_t shared = 0;
+    while (shared < sizeof(prevRef) - 1 && prevRef[shared] && prevRef[shared] == ref[shared]) shared++;
+    size_t suffixLen = strlen(ref + shared);
+    if (shared + suffixLen > sizeof(prevRef) - 1) suffixLen = sizeof(prevRef) - 1 - shared;
+
+    size_t n = 0;
+    n += putVarint(rec + n, zigzag((int32_t)(ts - prevTs)));
+    n += putVarint(rec + n, zigzag(cents - prevCents));
+    n += putVarint(rec + n, (value << 1) | mode);
+    n += putVarint(rec + n, shared);
+    n += putVarint(rec + n, suffixLen);
+    memcpy(rec + n, ref + shared, suffixLen);
+    n += suffixLen;
+    seg.write(rec, n);
+
+    memcpy(prevRef + shared, ref + shared, suffixLen);
+    prevRef[shared + suffixLen] = 0;
+    prevTs = ts;
+    prevCents = cents;
+    count++;
+
+    // Hardware tests are logged but are not sales
+    if (strncmp(ref, "TEST_", 5) == 0) continue;
+    summary.count++;
+    summary.revenueCents += cents;
+    if (mode == 1) {
+      summary.countCredit++;
+      summary.pulses += value;
+    } else {
+      summary.countTime++;
+      timeSeconds += value;
+    }
+  }
+  src.close();
+  summary.minutes = timeSeconds / 60;
+
+  uint8_t countBuf[4];
+  putU32(countBuf, count);
+  seg.seek(12);
+  seg.write(countBuf, sizeof(countBuf));
+  summary.segmentBytes = seg.size();
+  seg.flush(); // On disk before the caller drops the CSV
+  seg.close();
+
+  if (count == 0) {
+    dstFs.remove(path);
+    return false;
+  }
+  return appendSummary(dstFs, summary);
+}
+
+bool LogArchive::appendSummary(fs::FS &fs, const DaySummary &summary) {
+  // Re-sealing the same day after an interrupted rotation replaces the
+  // last entry instead of duplicating it
+  File idx = fs.open(ARCHIVE_INDEX, "r");
+  bool replaceLast = false;
+  if (idx) {
+    size_t size = idx.size();
+    if (size >= sizeof(DaySummary)) {
+      DaySummary last;
+      idx.seek(size - sizeof(DaySummary));
+      if (idx.read((uint8_t *)&last, sizeof(last)) == sizeof(last) && last.day == summary.day) {
+        replaceLast = true;
+      }
+    }
+    idx.close();
+  }
+
+  idx = fs.open(ARCHIVE_INDEX, replaceLast ? "r+" : "a");
+  if (!idx) return false;
+  if (replaceLast) idx.seek(idx.size() - sizeof(DaySummary));
+  bool ok = idx.write((const uint8_t *)&summary, sizeof(summary)) == sizeof(summary);
+  idx.flush();
+  idx.close();
+  return ok;
+}
+
+int LogArchive::prune(fs::FS &fs, int maxDays) {
+  int removed = 0;
+  for (;;) {
+    File dir = fs.open(ARCHIVE_DIR);
+    if (!dir) return removed;
+    int count = 0;
+    uint32_t oldest = UINT32_MAX;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+      const char *name = f.name();
+      const char *slash = strrchr(name, '/');
+      if (slash) name = slash + 1;
+      size_t len = strlen(name);
+      if (f.isDirectory() || len < 5 || strcmp(name + len - 4, ".seg") != 0) continue;
+      count++;
+      uint32_t day = strtoul(name, nullptr, 10);
+      if (day < oldest) oldest = day;
+    }
+    dir.close();
+    if (count <= maxDays || oldest == UINT32_MAX) return removed;
+    if (!fs.remove(segmentPath(oldest))) return removed;
+    removed++;
+  }
+}
+
+String LogArchive::summariesJson(fs::FS &fs, uint32_t from, uint32_t to) {
+  File idx = fs.open(ARCHIVE_INDEX, "r");
+  if (!idx) return "[]";
+
+  String json = "[";
+  DaySummary s;
+  while (idx.read((uint8_t *)&s, sizeof(s)) == sizeof(s)) {
+    if (s.day < from || s.day > to) continue;
+    if (json.length() > 1) json += ",";
+    json += "{\"day\":" + String(s.day) + ",\"count\":" + String(s.count) +
+            ",\"revenue\":" + String(s.revenueCents / 100.0, 2) +
+            ",\"minutes\":" + String(s.minutes) + ",\"pulses\":" + String(s.pulses) +
+            ",\"countTime\":" + String(s.countTime) + ",\"countCredit\":" + String(s.countCredit) +
+            ",\"segmentBytes\":" + String(s.segmentBytes) + ",\"rawBytes\":" + String(s.rawBytes) + "}";
+  }
+  idx.close();
+  json += "]";
+  return json;
+}
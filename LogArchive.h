@@ -0,0 +1,58 @@
+#ifndef LOGARCHIVE_H
+#define LOGARCHIVE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Daily archive segments for the activation log.
+//
+// Segment file (/logs/YYYYMMDD.seg), little-endian:
+//   "QRSG" | u8 version | u8[3] reserved | u32 day (YYYYMMDD) | u32 count
+//   then per record, all varints (LEB128):
+//     zigzag(ts - prevTs)            epoch seconds, 0 if clock was unset
+//     zigzag(cents - prevCents)      amount in centavos
+//     value << 1 | mode              seconds (time) or pulses (credit)
+//     shared prefix length with previous ref, suffix length, suffix bytes
+//
+// Summary index (/logs/summary.bin): one DaySummary per sealed day, appended
+// in order, so reports over months only read 32 bytes per day.
+// decode_archive.py decodes both on a PC.
+
+#define ARCHIVE_DIR "/logs"
+#define ARCHIVE_INDEX "/logs/summary.bin"
+#define ARCHIVE_MAGIC "QRSG"
+#define ARCHIVE_VERSION 1
+// Without an SD card the archive lives in LittleFS; keep it bounded
+#define ARCHIVE_FLASH_MAX_DAYS 31
+
+struct __attribute__((packed)) DaySummary {
+  uint32_t day;          // YYYYMMDD
+  uint32_t count;        // Sales (test activations excluded)
+  uint32_t revenueCents;
+  uint32_t minutes;      // Units sold in time mode
+  uint32_t pulses;       // Units sold in credit mode
+  uint16_t countTime;
+  uint16_t countCredit;
+  uint32_t segmentBytes; // Compressed size
+  uint32_t rawBytes;     // CSV size it replaced
+};
+
+class LogArchive {
+public:
+  // Encodes the CSV log into the day's segment and updates the index.
+  // Returns false (and leaves the CSV untouched) if nothing was written.
+  static bool sealDay(fs::FS &srcFs, const char *srcPath, fs::FS &dstFs, uint32_t day,
+                      DaySummary &summary);
+
+  static String segmentPath(uint32_t day);
+  // Deletes the oldest segments until at most maxDays remain (the index
+  // keeps their summaries); returns how many were removed
+  static int prune(fs::FS &fs, int maxDays);
+  // Summaries with from <= day <= to as a JSON array
+  static String summariesJson(fs::FS &fs, uint32_t from, uint32_t to);
+
+private:
+  static bool appendSummary(fs::FS &fs, const DaySummary &summary);
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "LogWriter.h"
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+#include <esp_system.h>
+
+#define LOG_RTC_MAGIC 0x4C4F4732 // "LOG2": per-target offsets
+
+// Pending records. RTC_NOINIT keeps the contents across every reset except
+// power loss; magic + CRC tell a valid buffer from power-on garbage.
+struct LogRtcBuffer {
+  uint32_t magic;
+  uint32_t length;
+  uint32_t crc;
+  uint32_t written[LOG_MAX_TARGETS]; // Bytes of data already on each target
+  uint8_t data[LOG_BUFFER_SIZE];
+};
+static RTC_NOINIT_ATTR LogRtcBuffer rtcLog;
+
+LogWriter *LogWriter::_instance = nullptr;
+
+LogWriter::LogWriter() {}
+
+bool LogWriter::addTarget(fs::FS &fs, const char *path, const char *mode) {
+  if (_numTargets >= LOG_MAX_TARGETS) return false;
+  Target &t = _targets[_numTargets++];
+  t.fs = &fs;
+  t.path = path;
+  t.mode = mode;
+  return true;
+}
+
+void LogWriter::begin() {
+  _instance = this;
+
+  bool valid = rtcLog.magic == LOG_RTC_MAGIC && rtcLog.length <= LOG_BUFFER_SIZE &&
+               rtcLog.crc == esp_rom_crc32_le(0, rtcLog.data, rtcLog.length);
+  for (int i = 0; valid && i < LOG_MAX_TARGETS; i++) {
+    if (rtcLog.written[i] > rtcLog.length) rtcLog.written[i] = 0; // Not covered by the CRC
+  }
+  if (valid && rtcLog.length > 0) {
+    // Records appended before an unexpected reset: commit them first
+    Serial.printf("LOG: Recovering %u pending bytes from RTC memory\n", rtcLog.length);
+    _stats.recovered = rtcLog.length;
+    commit();
+  } else if (!valid) {
+    rtcLog.magic = LOG_RTC_MAGIC;
+    rtcLog.length = 0; // Power-on garbage, nothing to count as dropped
+    discard();
+  }
+
+  esp_register_shutdown_handler(onShutdown);
+}
+
+void LogWriter::onShutdown() {
+  if (_instance) _instance->closeFiles();
+}
+
+void LogWriter::loop() {
+  if (rtcLog.length > 0 && millis() - _firstPendingAt >= LOG_COMMIT_INTERVAL_MS) {
+    commit();
+  }
+}
+
+size_t LogWriter::pending() const {
+  return rtcLog.length;
+}
+
+bool LogWriter::append(const char *line, size_t len) {
+  unsigned long t0 = micros();
+
+  if (rtcLog.length + len > LOG_BUFFER_SIZE) {
+    commit();
+    if (rtcLog.length > 0) {
+      // A target is still failing and the buffer is needed: its backlog goes
+      Serial.printf("LOG: Dropping %u bytes a target could not take\n", rtcLog.length);
+      discard();
+    }
+  }
+
+  if (len > LOG_BUFFER_SIZE) {
+    // Oversized record: bypass the buffer
+    for (int i = 0; i < _numTargets; i++) writeTarget(_targets[i], (const uint8_t *)line, len);
+  } else {
+    if (rtcLog.length == 0) _firstPendingAt = millis();
+    bool belowThreshold = rtcLog.length < LOG_COMMIT_THRESHOLD;
+    memcpy(rtcLog.data + rtcLog.length, line, len);
+    rtcLog.crc = esp_rom_crc32_le(rtcLog.crc, (const uint8_t *)line, len);
+    rtcLog.length += len;
+    // Only on crossing it; past that, a failing target is retried by loop()
+    if (belowThreshold && rtcLog.length >= LOG_COMMIT_THRESHOLD) commit();
+  }
+
+  uint32_t elapsed = micros() - t0;
+  _stats.records++;
+  _stats.appendUsTotal += elapsed;
+  if (elapsed > _stats.appendUsMax) _stats.appendUsMax = elapsed;
+  return true;
+}
+
+// Empties the buffer; bytes some target has not received are counted as dropped
+void LogWriter::discard() {
+  for (int i = 0; i < _numTargets; i++) {
+    if (rtcLog.written[i] < rtcLog.length) _stats.dropped += rtcLog.length - rtcLog.written[i];
+  }
+  for (int i = 0; i < LOG_MAX_TARGETS; i++) rtcLog.written[i] = 0;
+  rtcLog.length = 0;
+  rtcLog.crc = esp_rom_crc32_le(0, rtcLog.data, 0);
+}
+
+void LogWriter::flush() {
+  if (rtcLog.length > 0) commit();
+}
+
+void LogWriter::closeFiles() {
+  flush();
+  for (int i = 0; i < _numTargets; i++) {
+    if (_targets[i].file) _targets[i].file.close();
+  }
+}
+
+bool LogWriter::writeTarget(Target &t, const uint8_t *data, size_t len) {
+  if (!t.file) {
+    t.file = t.fs->open(t.path, t.mode);
+    if (!t.file) return false;
+  }
+  size_t written = t.file.write(data, len);
+  t.file.flush(); // One metadata update per group instead of per record
+  if (written != len) {
+    // Card pulled or FS full: drop the handle so the next commit retries
+    t.file.close();
+    return false;
+  }
+  return true;
+}
+
+void LogWriter::commit() {
+  unsigned long t0 = micros();
+  bool all = true;
+  for (int i = 0; i < _numTargets; i++) {
+    uint32_t &done = rtcLog.written[i];
+    // A short write is retried whole, so that target may see a fragment twice
+    if (done < rtcLog.length && writeTarget(_targets[i], rtcLog.data + done, rtcLog.length - done)) {
+      done = rtcLog.length;
+    }
+    if (done < rtcLog.length) all = false;
+  }
+
+  if (all) {
+    discard();
+  } else {
+    _firstPendingAt = millis(); // Failed targets are retried next window
+  }
+
+  uint32_t elapsed = micros() - t0;
+  _stats.commits++;
+  _stats.commitUsTotal += elapsed;
+  if (elapsed > _stats.commitUsMax) _stats.commitUsMax = elapsed;
+}
@@ -0,0 +1,73 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Commit window: pending records reach the files at most this late
+#define LOG_COMMIT_INTERVAL_MS 2000
+// Pending buffer size (lives in RTC memory, so keep it small)
+#define LOG_BUFFER_SIZE 2048
+// Commit early once this much is pending
+#define LOG_COMMIT_THRESHOLD (LOG_BUFFER_SIZE * 3 / 4)
+
+#define LOG_MAX_TARGETS 2
+
+// Group-commit write-behind buffer for the activation logs.
+// append() only copies the record into a buffer kept in RTC memory; records
+// are written to every target in a single write + flush when the buffer
+// fills or the commit window expires. File handles stay open between commits.
+// Each target keeps its own offset into the buffer, so one that fails (card
+// pulled) is retried every window without holding back or duplicating the
+// others; its backlog is only dropped when the buffer has to make room.
+//
+// Durability: the RTC buffer survives software resets, panics and watchdog
+// resets and is replayed by begin(); esp_restart() (OTA, reboot) flushes it
+// through a shutdown hook. Only a power cut can lose up to one window.
+class LogWriter {
+public:
+  struct Stats {
+    uint32_t records = 0;
+    uint32_t commits = 0;
+    uint32_t appendUsTotal = 0; // Time spent inside append()
+    uint32_t appendUsMax = 0;
+    uint32_t commitUsTotal = 0; // Time spent writing + flushing
+    uint32_t commitUsMax = 0;
+    uint32_t recovered = 0;     // Bytes replayed from RTC after a reset
+    uint32_t dropped = 0;       // Bytes a failing target never got (buffer full)
+  };
+
+  LogWriter();
+  bool addTarget(fs::FS &fs, const char *path, const char *mode);
+  void begin();
+  void loop();
+
+  bool append(const char *line, size_t len);
+  void flush();      // Commit pending records now
+  void closeFiles(); // Flush and release handles (before remove/rename)
+
+  size_t pending() const;
+  const Stats &getStats() const { return _stats; }
+
+private:
+  struct Target {
+    fs::FS *fs = nullptr;
+    const char *path = nullptr;
+    const char *mode = nullptr;
+    File file;
+  };
+
+  Target _targets[LOG_MAX_TARGETS];
+  int _numTargets = 0;
+  unsigned long _firstPendingAt = 0;
+  Stats _stats;
+
+  void commit();
+  void discard();
+  bool writeTarget(Target &t, const uint8_t *data, size_t len);
+
+  static void onShutdown();
+  static LogWriter *_instance;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "MemoryManager.h"
+#include <esp_heap_caps.h>
+
+MemoryManager memoryManager;
+
+MemoryManager::MemoryManager() {
+  static const char *names[MEM_ARENA_COUNT] = {"display", "lvgl", "ads", "decode", "qr", "upload"};
+  static const size_t budgets[MEM_ARENA_COUNT] = {MEM_BUDGET_DISPLAY, MEM_BUDGET_LVGL, MEM_BUDGET_ADS,
+                                                  MEM_BUDGET_DECODE,  MEM_BUDGET_QR,   MEM_BUDGET_UPLOAD};
+  for (int i = 0; i < MEM_ARENA_COUNT; i++) {
+    _arenas[i] = {names[i], budgets[i], 0, 0, 0, 0, 0};
+  }
+}
+
+void *MemoryManager::alloc(MemArena arena, size_t size, bool allowSram) {
+  Arena &a = _arenas[arena];
+  portENTER_CRITICAL(&_mux);
+  size_t inUse = a.inUse, budget = a.budget;
+  bool fits = inUse + size <= budget;
+  if (fits) a.inUse += size; // Reserved until the heap answers
+  else a.failures++;
+  portEXIT_CRITICAL(&_mux);
+  if (!fits) {
+    Serial.printf("MEM: %s over budget (%u + %u > %u)\n", a.name, inUse, size, budget);
+    return nullptr;
+  }
+
+  bool sram = false;
+  void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!p && allowSram) {
+    p = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    sram = p != nullptr;
+  }
+  // Account the real block size so free() balances exactly
+  size_t real = p ? heap_caps_get_allocated_size(p) : 0;
+
+  portENTER_CRITICAL(&_mux);
+  a.inUse = a.inUse - size + real;
+  if (p) {
+    a.allocs++;
+    if (sram) a.sramFallbacks++;
+    if (a.inUse > a.highWater) a.highWater = a.inUse;
+  } else {
+    a.failures++;
+  }
+  portEXIT_CRITICAL(&_mux);
+
+  if (sram) Serial.printf("MEM: %s got %u bytes from SRAM (PSRAM full)\n", a.name, size);
+  if (!p) Serial.printf("MEM: %s allocation of %u bytes failed\n", a.name, size);
+  return p;
+}
+
+void MemoryManager::free(MemArena arena, void *ptr) {
+  if (!ptr) return;
+  Arena &a = _arenas[arena];
+  size_t size = heap_caps_get_allocated_size(ptr);
+  heap_caps_free(ptr);
+  portENTER_CRITICAL(&_mux);
+  a.inUse = size < a.inUse ? a.inUse - size : 0;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void MemoryManager::setBudget(MemArena arena, size_t bytes) {
+  portENTER_CRITICAL(&_mux);
+  _arenas[arena].budget = bytes;
+  portEXIT_CRITICAL(&_mux);
+}
+
+MemoryManager::Arena MemoryManager::arena(MemArena arena) const {
+  portENTER_CRITICAL(&_mux);
+  Arena a = _arenas[arena];
+  portEXIT_CRITICAL(&_mux);
+  return a;
+}
+
+String MemoryManager::toJson() const {
+  Arena arenas[MEM_ARENA_COUNT];
+  portENTER_CRITICAL(&_mux);
+  memcpy(arenas, _arenas, sizeof(arenas));
+  portEXIT_CRITICAL(&_mux);
+
+  String json = "{\"arenas\":[";
+  for (int i = 0; i < MEM_ARENA_COUNT; i++) {
+    const Arena &a = arenas[i];
+    char buf[192];
+    snprintf(buf, sizeof(buf),
+             "%s{\"name\":\"%s\",\"budget\":%u,\"inUse\":%u,\"highWater\":%u,\"allocs\":%u,"
+             "\"failures\":%u,\"sramFallbacks\":%u}",
+             i ? "," : "", a.name, a.budget, a.inUse, a.highWater, a.allocs, a.failures, a.sramFallbacks);
+    json += buf;
+  }
+
+  size_t heapFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  size_t heapLargest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+  size_t psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  size_t psramLargest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  char buf[320];
+  snprintf(buf, sizeof(buf),
+           "],\"heap\":{\"free\":%u,\"minFree\":%u,\"largestBlock\":%u,\"fragmentation\":%u},"
+           "\"psram\":{\"free\":%u,\"minFree\":%u,\"largestBlock\":%u,\"fragmentation\":%u}}",
+           heapFree, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL), heapLargest,
+           heapFree ? 100 - heapLargest * 100 / heapFree : 0, psramFree,
+           heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM), psramLargest,
+           psramFree ? 100 - psramLargest * 100 / psramFree : 0);
+  json += buf;
+  return json;
+}
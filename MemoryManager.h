@@ -0,0 +1,62 @@
+#ifndef MEMORYMANAGER_H
+#define MEMORYMANAGER_H
+
+#include <Arduino.h>
+
+// Owners of the large buffers. Each has a byte budget; allocations that
+// would exceed it fail instead of eating into the others' memory.
+enum MemArena {
+  MEM_DISPLAY, // Canvas framebuffer
+  MEM_LVGL,    // LVGL draw buffer
+  MEM_ADS,     // Decoded ad frames (AdDecoder cache)
+  MEM_DECODE,  // Video read buffer, PNG/thumbnail scratch
+  MEM_QR,      // QR canvas and module buffers
+  MEM_UPLOAD,  // Ad upload write buffer
+  MEM_ARENA_COUNT
+};
+
+// Default budgets; AdDecoder sets MEM_ADS from its cache budget
+#define MEM_BUDGET_DISPLAY (320 * 1024)
+#define MEM_BUDGET_LVGL (64 * 1024)
+#define MEM_BUDGET_ADS (3 * 1024 * 1024)
+#define MEM_BUDGET_DECODE (512 * 1024)
+#define MEM_BUDGET_QR (160 * 1024)
+#define MEM_BUDGET_UPLOAD (32 * 1024)
+
+// Named arenas over the ESP heap. Buffers come from PSRAM; internal SRAM
+// is only used as a fallback when the caller allows it, and every fallback
+// is counted and logged. Tracks usage and high-water marks per arena so a
+// leak or a budget that is too tight shows up in /api/mem long before the
+// heap runs out. Safe to call from any task: the budget check reserves the
+// bytes under a spinlock, and the heap call itself runs outside it.
+class MemoryManager {
+public:
+  struct Arena {
+    const char *name;
+    size_t budget;
+    size_t inUse;
+    size_t highWater;
+    uint32_t allocs;
+    uint32_t failures;      // Over budget or heap exhausted
+    uint32_t sramFallbacks; // PSRAM full, served from internal SRAM
+  };
+
+  MemoryManager();
+
+  void *alloc(MemArena arena, size_t size, bool allowSram = true);
+  void free(MemArena arena, void *ptr);
+
+  void setBudget(MemArena arena, size_t bytes);
+  Arena arena(MemArena arena) const; // Consistent copy
+
+  // Arenas plus heap/PSRAM free space, largest block and fragmentation
+  String toJson() const;
+
+private:
+  Arena _arenas[MEM_ARENA_COUNT];
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern MemoryManager memoryManager;
+
+#endif
@@ -0,0 +1,63 @@
+#include "PerfHistogram.h"
+
+PerfHistogram::PerfHistogram() {
+  memset(&_d, 0, sizeof(_d));
+}
+
+void PerfHistogram::add(uint32_t value) {
+  int b = value ? 31 - __builtin_clz(value) : 0;
+  if (b >= PERF_BUCKETS) b = PERF_BUCKETS - 1;
+  portENTER_CRITICAL(&_mux);
+  _d.buckets[b]++;
+  _d.count++;
+  _d.sum += value;
+  _d.last = value;
+  if (value > _d.max) _d.max = value;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void PerfHistogram::decay() {
+  portENTER_CRITICAL(&_mux);
+  uint32_t count = 0;
+  for (int i = 0; i < PERF_BUCKETS; i++) {
+    _d.buckets[i] >>= 1;
+    count += _d.buckets[i];
+  }
+  // Keep the average consistent with what is left
+  _d.sum = _d.count ? _d.sum * count / _d.count : 0;
+  _d.count = count;
+  _d.max = 0;
+  portEXIT_CRITICAL(&_mux);
+}
+
+PerfHistogram::Data PerfHistogram::snapshot() const {
+  portENTER_CRITICAL(&_mux);
+  Data d = _d;
+  portEXIT_CRITICAL(&_mux);
+  return d;
+}
+
+uint32_t PerfHistogram::percentile(const Data &d, uint8_t p) {
+  if (d.count == 0) return 0;
+  uint32_t target = ((uint64_t)d.count * p + 99) / 100;
+  uint32_t seen = 0;
+  for (int i = 0; i < PERF_BUCKETS; i++) {
+    seen += d.buckets[i];
+    if (seen >= target) return (1UL << (i + 1)) - 1;
+  }
+  return d.max;
+}
+
+String PerfHistogram::toJson() const {
+  Data d = snapshot(); // One consistent view for every field
+  char buf[160];
+  snprintf(buf, sizeof(buf), "{\"count\":%u,\"last\":%u,\"avg\":%u,\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u,\"buckets\":[",
+           d.count, d.last, average(d), percentile(d, 50), percentile(d, 95), percentile(d, 99), d.max);
+  String json = buf;
+  for (int i = 0; i < PERF_BUCKETS; i++) {
+    if (i) json += ",";
+    json += String(d.buckets[i]);
+  }
+  json += "]}";
+  return json;
+}
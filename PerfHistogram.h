@@ -0,0 +1,47 @@
+#ifndef PERFHISTOGRAM_H
+#define PERFHISTOGRAM_H
+
+#include <Arduino.h>
+
+// Bucket i holds samples in [2^i, 2^(i+1)); bucket 0 also holds 0 and the
+// last one everything above. 20 buckets cover 1 us .. 1 s or 1 B .. 1 MB.
+#define PERF_BUCKETS 20
+
+// Rolling log2 histogram. decay() halves every bucket, so old samples fade
+// out and the percentiles follow what the device is doing now; call it on a
+// fixed period (DisplayManager does every 10 s).
+// add() and decay() may run on other tasks than the readers (flush/UI vs
+// the /api/perf handler): every access takes a short spinlock, and readers
+// work from a copy.
+class PerfHistogram {
+public:
+  PerfHistogram();
+  void add(uint32_t value);
+  void decay();
+
+  uint32_t count() const { return snapshot().count; }
+  uint32_t last() const { return snapshot().last; }
+  uint32_t windowMax() const { return snapshot().max; } // Largest since the last decay
+  uint32_t average() const { return average(snapshot()); }
+  // Upper bound of the bucket holding the p-th percentile (p in 1..100)
+  uint32_t percentile(uint8_t p) const { return percentile(snapshot(), p); }
+
+  String toJson() const;
+
+private:
+  struct Data {
+    uint32_t buckets[PERF_BUCKETS];
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t last;
+  };
+  Data _d;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+  Data snapshot() const;
+  static uint32_t average(const Data &d) { return d.count ? d.sum / d.count : 0; }
+  static uint32_t percentile(const Data &d, uint8_t p);
+};
+
+#endif
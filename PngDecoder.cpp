@@ -0,0 +1,275 @@
+#include "PngDecoder.h"
+#include "MemoryManager.h"
+#include <rom/miniz.h>
+
+#define PNG_DICT_SIZE TINFL_LZ_DICT_SIZE // 32 KB, power of two for the circular buffer
+
+static uint32_t readBE32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b) {
+  return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+static inline uint8_t blend(uint8_t c, uint8_t a) {
+  return (c * a + 255) >> 8; // Over black
+}
+
+static void *allocWork(size_t size) {
+  return memoryManager.alloc(MEM_DECODE, size);
+}
+
+bool PngDecoder::decode(fs::File &file, uint16_t *frame, int frameW, int frameH) {
+  PngDecoder d(file, frame, frameW, frameH);
+  return d.run();
+}
+
+PngDecoder::PngDecoder(fs::File &file, uint16_t *frame, int frameW, int frameH)
+    : _file(file), _frame(frame), _frameW(frameW), _frameH(frameH) {
+  memset(_paletteAlpha, 0xFF, sizeof(_paletteAlpha));
+  memset(_paletteRgb, 0, sizeof(_paletteRgb));
+}
+
+PngDecoder::~PngDecoder() {
+  memoryManager.free(MEM_DECODE, _inflator);
+  memoryManager.free(MEM_DECODE, _dict);
+  memoryManager.free(MEM_DECODE, _in);
+  memoryManager.free(MEM_DECODE, _cur);
+  memoryManager.free(MEM_DECODE, _prev);
+}
+
+bool PngDecoder::readHeader(uint32_t &len, char type[5]) {
+  uint8_t hdr[8];
+  if (_file.read(hdr, 8) != 8) return false;
+  len = readBE32(hdr);
+  memcpy(type, hdr + 4, 4);
+  type[4] = 0;
+  return true;
+}
+
+bool PngDecoder::run() {
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  uint8_t buf[13];
+  if (_file.read(buf, 8) != 8 || memcmp(buf, signature, 8) != 0) return false;
+
+  uint32_t len;
+  char type[5];
+  while (readHeader(len, type)) {
+    if (strcmp(type, "IHDR") == 0) {
+      if (len != 13 || _file.read(buf, 13) != 13) return false;
+      _width = readBE32(buf);
+      _height = readBE32(buf + 4);
+      _bitDepth = buf[8];
+      _colorType = buf[9];
+      if (buf[12] != 0) {
+        Serial.println("PNG: Interlaced images are not supported");
+        return false;
+      }
+      switch (_colorType) {
+        case 0: _channels = 1; break; // Gray
+        case 2: _channels = 3; break; // RGB
+        case 3: _channels = 1; break; // Palette
+        case 4: _channels = 2; break; // Gray + alpha
+        case 6: _channels = 4; break; // RGBA
+        default: return false;
+      }
+      if (_width == 0 || _height == 0 || _width > PNG_MAX_WIDTH) return false;
+      if (_bitDepth != 1 && _bitDepth != 2 && _bitDepth != 4 && _bitDepth != 8 && _bitDepth != 16) return false;
+      if (_bitDepth < 8 && _channels != 1) return false;
+      _rowBytes = (_width * _channels * _bitDepth + 7) / 8;
+      _bpp = (_channels * _bitDepth + 7) / 8;
+    } else if (strcmp(type, "PLTE") == 0) {
+      for (uint32_t i = 0; i < len / 3; i++) {
+        if (_file.read(_paletteRgb[i & 0xFF], 3) != 3) return false;
+      }
+      _file.seek(_file.position() + len % 3);
+    } else if (strcmp(type, "tRNS") == 0 && _colorType == 3) {
+      uint32_t n = len < 256 ? len : 256;
+      if (_file.read(_paletteAlpha, n) != n) return false;
+      _file.seek(_file.position() + len - n);
+    } else if (strcmp(type, "IDAT") == 0) {
+      if (_rowBytes == 0) return false; // IDAT before IHDR
+      return inflateImage(len);
+    } else if (strcmp(type, "IEND") == 0) {
+      return false; // No image data
+    } else {
+      _file.seek(_file.position() + len); // Ancillary chunk
+    }
+    _file.seek(_file.position() + 4); // CRC (not checked)
+  }
+  return false;
+}
+
+bool PngDecoder::inflateImage(uint32_t firstIdatLen) {
+  _inflator = (tinfl_decompressor_tag *)allocWork(sizeof(tinfl_decompressor));
+  _dict = (uint8_t *)allocWork(PNG_DICT_SIZE);
+  _in = (uint8_t *)allocWork(PNG_INPUT_SIZE);
+  _cur = (uint8_t *)allocWork(_rowBytes + 1);
+  _prev = (uint8_t *)allocWork(_rowBytes + 1);
+  if (!_inflator || !_dict || !_in || !_cur || !_prev) {
+    Serial.println("PNG: Out of memory");
+    return false;
+  }
+  memset(_prev, 0, _rowBytes + 1);
+
+  for (int i = 0; i < 256; i++) {
+    uint8_t a = _paletteAlpha[i];
+    _palette[i] = rgb565(blend(_paletteRgb[i][0], a), blend(_paletteRgb[i][1], a), blend(_paletteRgb[i][2], a));
+  }
+
+  // Sample down to fit, same 1/2/4/8 steps as the JPEG path, and center
+  while (_scale < 8 && (_width / _scale > (uint32_t)_frameW || _height / _scale > (uint32_t)_frameH)) _scale *= 2;
+  _offsetX = (_frameW - (int)(_width / _scale)) / 2;
+  _offsetY = (_frameH - (int)(_height / _scale)) / 2;
+
+  _idatRemaining = firstIdatLen;
+  tinfl_init((tinfl_decompressor *)_inflator);
+  size_t inAvail = 0, inPos = 0, dictOfs = 0;
+  bool moreInput = true;
+
+  for (;;) {
+    if (inPos == inAvail && moreInput) {
+      inAvail = readIdat(_in, PNG_INPUT_SIZE);
+      inPos = 0;
+      if (inAvail == 0) moreInput = false;
+    }
+
+    size_t inBytes = inAvail - inPos;
+    size_t outBytes = PNG_DICT_SIZE - dictOfs;
+    mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (moreInput ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    tinfl_status status = tinfl_decompress((tinfl_decompressor *)_inflator, _in + inPos, &inBytes, _dict,
+                                           _dict + dictOfs, &outBytes, flags);
+    inPos += inBytes;
+
+    if (outBytes > 0 && !consume(_dict + dictOfs, outBytes)) return true; // All rows done
+    dictOfs = (dictOfs + outBytes) & (PNG_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE) return _row == _height;
+    if (status < 0) {
+      Serial.printf("PNG: Inflate failed (%d) at row %u\n", (int)status, _row);
+      return false;
+    }
+  }
+}
+
+// Next IDAT payload bytes; the image data may be split over many chunks
+size_t PngDecoder::readIdat(uint8_t *buf, size_t max) {
+  size_t n = 0;
+  while (n < max && !_idatDone) {
+    if (_idatRemaining == 0) {
+      uint32_t len;
+      char type[5];
+      _file.seek(_file.position() + 4); // CRC of the previous IDAT
+      if (!readHeader(len, type) || strcmp(type, "IDAT") != 0) {
+        _idatDone = true;
+        break;
+      }
+      _idatRemaining = len;
+      continue;
+    }
+    size_t want = max - n < _idatRemaining ? max - n : _idatRemaining;
+    int got = _file.read(buf + n, want);
+    if (got <= 0) {
+      _idatDone = true;
+      break;
+    }
+    n += got;
+    _idatRemaining -= got;
+  }
+  return n;
+}
+
+// Assembles scanlines from inflated bytes. Returns false once the last row
+// has been emitted.
+bool PngDecoder::consume(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t take = _rowBytes + 1 - _rowFill;
+    if (take > len) take = len;
+    memcpy(_cur + _rowFill, data, take);
+    _rowFill += take;
+    data += take;
+    len -= take;
+
+    if (_rowFill == _rowBytes + 1) {
+      unfilterRow();
+      if (_row % _scale == 0) emitRow();
+      uint8_t *t = _prev;
+      _prev = _cur;
+      _cur = t;
+      _rowFill = 0;
+      if (++_row == _height) return false;
+    }
+  }
+  return true;
+}
+
+void PngDecoder::unfilterRow() {
+  uint8_t *x = _cur + 1;
+  const uint8_t *p = _prev + 1;
+  const size_t n = _rowBytes, bpp = _bpp;
+
+  switch (_cur[0]) {
+    case 0: break;
+    case 1: // Sub
+      for (size_t i = bpp; i < n; i++) x[i] += x[i - bpp];
+      break;
+    case 2: // Up
+      for (size_t i = 0; i < n; i++) x[i] += p[i];
+      break;
+    case 3: // Average
+      for (size_t i = 0; i < bpp; i++) x[i] += p[i] >> 1;
+      for (size_t i = bpp; i < n; i++) x[i] += (x[i - bpp] + p[i]) >> 1;
+      break;
+    case 4: // Paeth
+      for (size_t i = 0; i < bpp; i++) x[i] += p[i];
+      for (size_t i = bpp; i < n; i++) {
+        int a = x[i - bpp], b = p[i], c = p[i - bpp];
+        int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+        x[i] += (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+      }
+      break;
+  }
+}
+
+// One channel of pixel x, as 8 bits (16-bit samples keep the high byte)
+uint8_t PngDecoder::sample(int x, int channel) const {
+  const uint8_t *row = _cur + 1;
+  if (_bitDepth == 8) return row[x * _channels + channel];
+  if (_bitDepth == 16) return row[(x * _channels + channel) * 2];
+
+  uint32_t bit = x * _bitDepth;
+  uint8_t mask = (1 << _bitDepth) - 1;
+  uint8_t v = (row[bit >> 3] >> (8 - _bitDepth - (bit & 7))) & mask;
+  return _colorType == 3 ? v : v * (255 / mask); // Palette index or scaled gray
+}
+
+uint16_t PngDecoder::pixel(int x) const {
+  switch (_colorType) {
+    case 0: {
+      uint8_t v = sample(x, 0);
+      return rgb565(v, v, v);
+    }
+    case 2: return rgb565(sample(x, 0), sample(x, 1), sample(x, 2));
+    case 3: return _palette[sample(x, 0)];
+    case 4: {
+      uint8_t v = blend(sample(x, 0), sample(x, 1));
+      return rgb565(v, v, v);
+    }
+    default: {
+      uint8_t a = sample(x, 3);
+      return rgb565(blend(sample(x, 0), a), blend(sample(x, 1), a), blend(sample(x, 2), a));
+    }
+  }
+}
+
+void PngDecoder::emitRow() {
+  int dy = _offsetY + (int)(_row / _scale);
+  if (dy < 0 || dy >= _frameH) return;
+
+  int dx0 = _offsetX < 0 ? 0 : _offsetX;
+  int dx1 = _offsetX + (int)(_width / _scale);
+  if (dx1 > _frameW) dx1 = _frameW;
+  uint16_t *out = _frame + dy * _frameW;
+  for (int dx = dx0; dx < dx1; dx++) out[dx] = pixel((dx - _offsetX) * _scale);
+}
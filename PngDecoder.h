@@ -0,0 +1,62 @@
+#ifndef PNGDECODER_H
+#define PNGDECODER_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define PNG_INPUT_SIZE 4096
+#define PNG_MAX_WIDTH 4096
+
+struct tinfl_decompressor_tag;
+
+// Streaming PNG decoder for ads. IDAT data is inflated with the ROM tinfl
+// (miniz) into a 32 KB circular dictionary and consumed one scanline at a
+// time, so only two rows are kept; the whole file is never loaded.
+// Supports every non-interlaced color type and bit depth: palette (with
+// tRNS alpha), gray, RGB and their alpha variants, alpha composited on black.
+// Images larger than the frame are sampled down by 2/4/8 like the JPEG path,
+// then centered. Working memory (~44 KB plus two rows, MEM_DECODE arena)
+// is freed on return.
+class PngDecoder {
+public:
+  static bool decode(fs::File &file, uint16_t *frame, int frameW, int frameH);
+
+private:
+  PngDecoder(fs::File &file, uint16_t *frame, int frameW, int frameH);
+  ~PngDecoder();
+
+  bool run();
+  bool readHeader(uint32_t &len, char type[5]);
+  bool inflateImage(uint32_t firstIdatLen);
+  size_t readIdat(uint8_t *buf, size_t max);
+  bool consume(const uint8_t *data, size_t len);
+  void unfilterRow();
+  void emitRow();
+  uint16_t pixel(int x) const;
+  uint8_t sample(int x, int channel) const;
+
+  fs::File &_file;
+  uint16_t *_frame;
+  int _frameW, _frameH;
+
+  uint32_t _width = 0, _height = 0;
+  uint8_t _bitDepth = 0, _colorType = 0, _channels = 0;
+  size_t _rowBytes = 0, _bpp = 0;
+  uint16_t _palette[256]; // RGB565, tRNS alpha already composited on black
+  uint8_t _paletteAlpha[256];
+  uint8_t _paletteRgb[256][3];
+
+  int _scale = 1, _offsetX = 0, _offsetY = 0;
+
+  tinfl_decompressor_tag *_inflator = nullptr;
+  uint8_t *_dict = nullptr;
+  uint8_t *_in = nullptr;
+  uint8_t *_cur = nullptr;  // Filter byte + current scanline
+  uint8_t *_prev = nullptr; // Previous scanline, unfiltered
+  size_t _rowFill = 0;
+  uint32_t _row = 0;
+  uint32_t _idatRemaining = 0;
+  bool _idatDone = false;
+};
+
+#endif
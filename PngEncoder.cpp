@@ -0,0 +1,89 @@
+#include "PngEncoder.h"
+#include "MemoryManager.h"
+#include <esp_rom_crc.h>
+
+static const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static void putBE32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+// Chunk at buf: 4 length bytes, then type + data already in place
+static bool writeChunk(Print &out, uint8_t *buf, uint32_t dataLen) {
+  putBE32(buf, dataLen);
+  putBE32(buf + 8 + dataLen, esp_rom_crc32_le(0, buf + 4, dataLen + 4));
+  size_t total = dataLen + 12;
+  return out.write(buf, total) == total;
+}
+
+size_t PngEncoder::encodedSize(int w, int h) {
+  size_t row = 12 + 5 + 1 + (size_t)w * 3; // Chunk overhead, stored block header, filter byte
+  return sizeof(PNG_SIGNATURE) + (12 + 13) + (size_t)h * row + 2 + 4 + 12;
+}
+
+bool PngEncoder::write(Print &out, const uint16_t *px, int w, int h, int rowStep, int colStep) {
+  if (rowStep == 0) rowStep = w;
+  size_t rowBytes = 1 + (size_t)w * 3;
+  if (rowBytes > 0xFFFF) return false; // One stored block per row
+  uint8_t *buf = (uint8_t *)memoryManager.alloc(MEM_DECODE, rowBytes + 12 + 2 + 5 + 4);
+  if (!buf) return false;
+
+  bool ok = out.write(PNG_SIGNATURE, sizeof(PNG_SIGNATURE)) == sizeof(PNG_SIGNATURE);
+
+  memcpy(buf + 4, "IHDR", 4);
+  putBE32(buf + 8, w);
+  putBE32(buf + 12, h);
+  buf[16] = 8; // Bit depth
+  buf[17] = 2; // RGB
+  buf[18] = buf[19] = buf[20] = 0;
+  ok = ok && writeChunk(out, buf, 13);
+
+  uint32_t adlerA = 1, adlerB = 0;
+  for (int y = 0; ok && y < h; y++) {
+    uint8_t *p = buf + 8;
+    memcpy(buf + 4, "IDAT", 4);
+    if (y == 0) {
+      *p++ = 0x78; // zlib header: deflate, 32 KB window, no preset dict
+      *p++ = 0x01;
+    }
+    *p++ = y == h - 1; // BFINAL on the last row, BTYPE 00 (stored)
+    *p++ = rowBytes & 0xFF;
+    *p++ = rowBytes >> 8;
+    *p++ = ~rowBytes & 0xFF;
+    *p++ = (~rowBytes >> 8) & 0xFF;
+
+    uint8_t *row = p;
+    *p++ = 0; // Filter: none
+    const uint16_t *s = px + (ptrdiff_t)y * rowStep;
+    for (int x = 0; x < w; x++, s += colStep) {
+      uint16_t c = *s;
+      uint8_t r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+      *p++ = (r << 3) | (r >> 2);
+      *p++ = (g << 2) | (g >> 4);
+      *p++ = (b << 3) | (b >> 2);
+    }
+
+    // Adler-32 of the uncompressed data; rows are short enough to reduce once
+    for (size_t i = 0; i < rowBytes; i++) {
+      adlerA += row[i];
+      adlerB += adlerA;
+      if (adlerB >= 0x80000000UL) adlerB %= 65521;
+    }
+    adlerA %= 65521;
+    adlerB %= 65521;
+    if (y == h - 1) {
+      putBE32(p, (adlerB << 16) | adlerA);
+      p += 4;
+    }
+    ok = writeChunk(out, buf, p - (buf + 8));
+  }
+
+  memcpy(buf + 4, "IEND", 4);
+  ok = ok && writeChunk(out, buf, 0);
+
+  memoryManager.free(MEM_DECODE, buf);
+  return ok;
+}
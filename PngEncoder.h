@@ -0,0 +1,19 @@
+#ifndef PNGENCODER_H
+#define PNGENCODER_H
+
+#include <Arduino.h>
+
+// Writes an RGB565 frame as an uncompressed PNG: the zlib stream uses
+// stored blocks, one per scanline, each in its own IDAT chunk. The size is
+// known before the first byte and only one RGB888 row is held, so a
+// screenshot can be streamed straight to a socket with a Content-Length.
+// About 1.5x the raw frame; meant for debugging, not storage.
+// Pixel (x, y) is px[y * rowStep + x * colStep], so a rotated framebuffer
+// can be written without copying it (rowStep 0 means w).
+class PngEncoder {
+public:
+  static size_t encodedSize(int w, int h);
+  static bool write(Print &out, const uint16_t *px, int w, int h, int rowStep = 0, int colStep = 1);
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef PRICING_H
+#define PRICING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Price of a purchase in integer centavos, shared by the keypad total, the
+// TFT payment callback and /create_payment so the three always agree.
+// Settings stay floats in pesos/percent; they are converted once when the
+// rules are built, and the threshold check is a single compare per quote.
+//
+// Policy: the promo discount applies from promoThreshold units on, and
+// never in fixed QR mode (the fixed amount is the price).
+
+struct PriceQuote {
+  int64_t totalCentavos;
+  bool promoApplied;
+};
+
+class PriceRules {
+public:
+  static constexpr int32_t NO_PROMO = INT32_MAX;
+
+  constexpr PriceRules() : _unitCentavos(0), _promoFrom(NO_PROMO), _keepBp(10000), _discountBp(0) {}
+  constexpr PriceRules(int32_t unitCentavos, int32_t promoFrom, int32_t discountBp)
+      : _unitCentavos(unitCentavos), _promoFrom(discountBp > 0 ? promoFrom : NO_PROMO),
+        _keepBp(10000 - clampBp(discountBp)), _discountBp(clampBp(discountBp)) {}
+
+  // opMode 2 is fixed QR; promoPercent is the discount (12.5 = 12.5 %)
+  static constexpr PriceRules fromSettings(float pricePerUnit, int opMode, bool promoEnabled, int promoThreshold,
+                                           float promoPercent) {
+    return PriceRules(toCentavos(pricePerUnit), promoEnabled && opMode != 2 ? promoThreshold : NO_PROMO,
+                      toBasisPoints(promoPercent));
+  }
+
+  constexpr PriceQuote quote(int32_t units) const {
+    return promoApplies(units) ? PriceQuote{keep((int64_t)units * _unitCentavos), true}
+                               : PriceQuote{(int64_t)units * _unitCentavos, false};
+  }
+
+  constexpr int32_t unitCentavos() const { return _unitCentavos; }
+  constexpr int32_t discountBasisPoints() const { return _discountBp; }
+  constexpr bool promoApplies(int32_t units) const { return _promoFrom != NO_PROMO && units >= _promoFrom; }
+
+  static constexpr int32_t toCentavos(float pesos) {
+    return pesos >= 0 ? (int32_t)(pesos * 100.0f + 0.5f) : -(int32_t)(-pesos * 100.0f + 0.5f);
+  }
+  static constexpr int32_t toBasisPoints(float percent) { return toCentavos(percent); }
+  static constexpr float toPesos(int64_t centavos) { return centavos / 100.0f; }
+
+  // "1234.50"; returns the length like snprintf
+  static int format(char *buf, size_t size, int64_t centavos) {
+    const char *sign = centavos < 0 ? "-" : "";
+    if (centavos < 0) centavos = -centavos;
+    return snprintf(buf, size, "%s%lld.%02d", sign, (long long)(centavos / 100), (int)(centavos % 100));
+  }
+
+private:
+  static constexpr int32_t clampBp(int32_t bp) { return bp < 0 ? 0 : bp > 10000 ? 10000 : bp; }
+  // total * keep / 10000, rounded half up; split so INT32_MAX units at
+  // INT32_MAX centavos do not overflow the product
+  constexpr int64_t keep(int64_t total) const {
+    return total / 10000 * _keepBp + (total % 10000 * _keepBp + 5000) / 10000;
+  }
+
+  int32_t _unitCentavos;
+  int32_t _promoFrom; // Units from which the discount applies, NO_PROMO if never
+  int32_t _keepBp;    // 10000 - discount, in basis points
+  int32_t _discountBp;
+};
+
+// Checked at compile time on every build; test/pricing_test.cpp covers more
+static_assert(PriceRules::toCentavos(10.0f) == 1000, "pesos to centavos");
+static_assert(PriceRules::toCentavos(0.1f) == 10, "rounds to the nearest centavo");
+static_assert(PriceRules::fromSettings(10.0f, 0, false, 5, 10.0f).quote(7).totalCentavos == 7000, "no promo");
+static_assert(!PriceRules::fromSettings(10.0f, 0, true, 5, 10.0f).quote(4).promoApplied, "below threshold");
+static_assert(PriceRules::fromSettings(10.0f, 0, true, 5, 10.0f).quote(5).totalCentavos == 4500, "10 % off at 5");
+static_assert(PriceRules::fromSettings(3.33f, 1, true, 1, 12.5f).quote(3).totalCentavos == 874, "rounds half up");
+static_assert(!PriceRules::fromSettings(10.0f, 2, true, 1, 50.0f).quote(3).promoApplied, "no promo in fixed mode");
+static_assert(PriceRules::fromSettings(10.0f, 0, true, 0, 0.0f).quote(3).totalCentavos == 3000, "0 % is no promo");
+static_assert(PriceRules::fromSettings(1000.0f, 0, false, 0, 0).quote(999999).totalCentavos == 99999900000LL,
+              "six keypad digits do not overflow");
+
+#endif
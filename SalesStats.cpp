@@ -0,0 +1,177 @@
+#include "SalesStats.h"
+#include <LittleFS.h>
+#include <esp_system.h>
+
+#define STATS_MAGIC 0x53544133    // "STA3": totals count QR-originated sales
+#define STATS_MAGIC_V2 0x53544132 // "STA2": StatsTotal without qrSales
+#define STATS_MAGIC_V1 0x53544131 // "STA1": lifetime total was a StatsBucket
+
+struct StatsTotalV2 {
+  uint64_t revenueCents;
+  uint32_t units;
+  uint32_t sales;
+  uint32_t promoSales;
+  uint32_t qrGenerated;
+};
+
+SalesStats *SalesStats::_instance = nullptr;
+
+SalesStats::SalesStats() {
+  memset(_hourly, 0, sizeof(_hourly));
+  memset(_daily, 0, sizeof(_daily));
+  memset(&_total, 0, sizeof(_total));
+}
+
+void SalesStats::begin(long tzOffsetSec) {
+  _tzOffset = tzOffsetSec;
+  _lastCheckpoint = millis();
+  _instance = this;
+  esp_register_shutdown_handler(onShutdown);
+
+  File file = LittleFS.open(_filename, "r");
+  if (!file) return;
+
+  uint32_t magic = 0;
+  bool ok = file.read((uint8_t *)&magic, sizeof(magic)) == sizeof(magic) &&
+            (magic == STATS_MAGIC || magic == STATS_MAGIC_V2 || magic == STATS_MAGIC_V1) &&
+            file.read((uint8_t *)_hourly, sizeof(_hourly)) == sizeof(_hourly) &&
+            file.read((uint8_t *)_daily, sizeof(_daily)) == sizeof(_daily);
+  // Older checkpoints: their qrSales are 0 (the bucket field was reserved)
+  if (ok && magic == STATS_MAGIC_V1) {
+    StatsBucket old;
+    ok = file.read((uint8_t *)&old, sizeof(old)) == sizeof(old);
+    _total = {old.revenueCents, old.units, old.sales, old.promoSales, old.qrGenerated, 0};
+  } else if (ok && magic == STATS_MAGIC_V2) {
+    StatsTotalV2 old;
+    ok = file.read((uint8_t *)&old, sizeof(old)) == sizeof(old);
+    _total = {old.revenueCents, old.units, old.sales, old.promoSales, old.qrGenerated, 0};
+  } else if (ok) {
+    ok = file.read((uint8_t *)&_total, sizeof(_total)) == sizeof(_total);
+  }
+  file.close();
+
+  if (!ok) {
+    Serial.println("STATS: Checkpoint invalid, starting empty");
+    memset(_hourly, 0, sizeof(_hourly));
+    memset(_daily, 0, sizeof(_daily));
+    memset(&_total, 0, sizeof(_total));
+  }
+}
+
+void SalesStats::loop() {
+  if (_dirty && millis() - _lastCheckpoint >= STATS_CHECKPOINT_MS) {
+    checkpoint();
+  }
+}
+
+// esp_restart() (OTA, reboot from the panel) would lose up to STATS_CHECKPOINT_MS
+void SalesStats::onShutdown() {
+  if (_instance && _instance->_dirty) _instance->checkpoint();
+}
+
+void SalesStats::checkpoint() {
+  _lastCheckpoint = millis();
+  File file = LittleFS.open(_filename, "w");
+  if (!file) return;
+  uint32_t magic = STATS_MAGIC;
+  file.write((const uint8_t *)&magic, sizeof(magic));
+  file.write((const uint8_t *)_hourly, sizeof(_hourly));
+  file.write((const uint8_t *)_daily, sizeof(_daily));
+  file.write((const uint8_t *)&_total, sizeof(_total));
+  file.close();
+  _dirty = false;
+}
+
+// Returns the ring slot for key, recycling it if it still holds an older period.
+// Before NTP sync keys are near 1970 and get recycled once real time arrives;
+// lifetime totals are unaffected.
+StatsBucket &SalesStats::slot(StatsBucket *ring, int size, uint32_t key) {
+  StatsBucket &b = ring[key % size];
+  if (b.key != key) {
+    memset(&b, 0, sizeof(b));
+    b.key = key;
+  }
+  return b;
+}
+
+void SalesStats::recordQr() {
+  time_t now = time(nullptr);
+  slot(_hourly, STATS_HOURLY_BUCKETS, now / 3600).qrGenerated++;
+  slot(_daily, STATS_DAILY_BUCKETS, (now + _tzOffset) / 86400).qrGenerated++;
+  _total.qrGenerated++;
+  _dirty = true;
+}
+
+void SalesStats::recordSale(uint32_t revenueCents, uint32_t units, bool promo, bool fromQr) {
+  time_t now = time(nullptr);
+  StatsBucket *buckets[2] = {&slot(_hourly, STATS_HOURLY_BUCKETS, now / 3600),
+                             &slot(_daily, STATS_DAILY_BUCKETS, (now + _tzOffset) / 86400)};
+  for (StatsBucket *b : buckets) {
+    b->revenueCents += revenueCents;
+    b->units += units;
+    b->sales++;
+    if (promo) b->promoSales++;
+    if (fromQr) b->qrSales++;
+  }
+  _total.revenueCents += revenueCents;
+  _total.units += units;
+  _total.sales++;
+  if (promo) _total.promoSales++;
+  if (fromQr) _total.qrSales++;
+  _dirty = true;
+}
+
+void SalesStats::appendBucketJson(String &json, const StatsBucket &b, const char *keyName) {
+  appendJson(json, keyName, b.key, b.revenueCents, b.units, b.sales, b.promoSales, b.qrGenerated, b.qrSales);
+}
+
+// conversion is paid QRs per generated QR. Only sales tagged as coming from
+// a generated QR count, so it stays within 0..1 without clamping.
+void SalesStats::appendJson(String &json, const char *keyName, uint32_t key, uint64_t revenueCents,
+                            uint32_t units, uint32_t sales, uint32_t promoSales, uint32_t qrGenerated,
+                            uint32_t qrSales) {
+  char buf[240];
+  snprintf(buf, sizeof(buf),
+           "{\"%s\":%u,\"revenue\":%.2f,\"units\":%u,\"sales\":%u,\"avgTicket\":%.2f,"
+           "\"promoSales\":%u,\"qrGenerated\":%u,\"qrSales\":%u,\"conversion\":%.3f}",
+           keyName, key, revenueCents / 100.0, units, sales, sales ? revenueCents / 100.0 / sales : 0.0,
+           promoSales, qrGenerated, qrSales, qrGenerated ? (float)qrSales / qrGenerated : 0.0f);
+  json += buf;
+}
+
+// Fixed size output: cost does not depend on how many sales were logged.
+// Hourly keys are epoch hours (UTC), daily keys are local epoch days;
+// empty or stale slots are skipped.
+String SalesStats::toJson() {
+  time_t now = time(nullptr);
+  uint32_t hourNow = now / 3600;
+  uint32_t dayNow = (now + _tzOffset) / 86400;
+
+  String json;
+  json.reserve(240 * (STATS_HOURLY_BUCKETS + STATS_DAILY_BUCKETS + 1));
+  json = "{\"total\":";
+  appendJson(json, "key", 0, _total.revenueCents, _total.units, _total.sales, _total.promoSales,
+             _total.qrGenerated, _total.qrSales);
+
+  json += ",\"hourly\":[";
+  bool first = true;
+  for (int i = STATS_HOURLY_BUCKETS - 1; i >= 0; i--) {
+    const StatsBucket &b = _hourly[(hourNow - i) % STATS_HOURLY_BUCKETS];
+    if (b.key != hourNow - i || (b.sales == 0 && b.qrGenerated == 0)) continue;
+    if (!first) json += ",";
+    appendBucketJson(json, b, "hour");
+    first = false;
+  }
+
+  json += "],\"daily\":[";
+  first = true;
+  for (int i = STATS_DAILY_BUCKETS - 1; i >= 0; i--) {
+    const StatsBucket &b = _daily[(dayNow - i) % STATS_DAILY_BUCKETS];
+    if (b.key != dayNow - i || (b.sales == 0 && b.qrGenerated == 0)) continue;
+    if (!first) json += ",";
+    appendBucketJson(json, b, "day");
+    first = false;
+  }
+  json += "]}";
+  return json;
+}
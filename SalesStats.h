@@ -0,0 +1,67 @@
+#ifndef SALESSTATS_H
+#define SALESSTATS_H
+
+#include <Arduino.h>
+
+#define STATS_HOURLY_BUCKETS 48            // Last 2 days, one per hour
+#define STATS_DAILY_BUCKETS 31             // Last month, one per local day
+#define STATS_CHECKPOINT_MS (10 * 60000UL) // Flash write at most every 10 min
+
+struct StatsBucket {
+  uint32_t key;          // Epoch hour / local epoch day held by this slot
+  uint32_t revenueCents;
+  uint32_t units;
+  uint16_t sales;
+  uint16_t promoSales;
+  uint16_t qrGenerated;
+  uint16_t qrSales;      // Sales paid through a QR generated for them
+};
+
+// Lifetime totals outgrow a bucket's 16-bit counts and 32-bit cents
+struct StatsTotal {
+  uint64_t revenueCents;
+  uint32_t units;
+  uint32_t sales;
+  uint32_t promoSales;
+  uint32_t qrGenerated;
+  uint32_t qrSales;
+};
+
+// Incremental sales statistics. Every sale/QR updates a fixed set of ring
+// buffer buckets in O(1), so /api/stats never has to scan the log.
+// Buckets are checkpointed to LittleFS (periodically and on restart) and
+// restored on boot.
+class SalesStats {
+public:
+  SalesStats();
+  void begin(long tzOffsetSec);
+  void loop();
+
+  void recordQr();
+  // fromQr: the payment came from a QR counted by recordQr()
+  void recordSale(uint32_t revenueCents, uint32_t units, bool promo, bool fromQr);
+
+  String toJson();
+  void checkpoint();
+
+private:
+  const char *_filename = "/stats.bin";
+  long _tzOffset = 0;
+
+  StatsBucket _hourly[STATS_HOURLY_BUCKETS];
+  StatsBucket _daily[STATS_DAILY_BUCKETS];
+  StatsTotal _total;
+
+  bool _dirty = false;
+  unsigned long _lastCheckpoint = 0;
+
+  StatsBucket &slot(StatsBucket *ring, int size, uint32_t key);
+  void appendBucketJson(String &json, const StatsBucket &b, const char *keyName);
+  void appendJson(String &json, const char *keyName, uint32_t key, uint64_t revenueCents, uint32_t units,
+                  uint32_t sales, uint32_t promoSales, uint32_t qrGenerated, uint32_t qrSales);
+
+  static void onShutdown();
+  static SalesStats *_instance;
+};
+
+#endif
@@ -28,11 +28,79 @@ bool SettingsManager::begin() {
       SD.mkdir("/logs");
       Serial.println("Created /logs directory");
     }
+
+    // One directory pass now; later listings come from RAM
+    adManifest.begin(SD, "/ads", "/ads.idx");
+  }
+
+  // Both logs are fed through one group-commit buffer
+  _logWriter.addTarget(LittleFS, _logFilename, "a");
+  if (_sdAvailable) _logWriter.addTarget(SD, _sdLogFilename, FILE_APPEND);
+  _logWriter.begin();
+
+  File dayFile = LittleFS.open(_logDayFilename, "r");
+  if (dayFile) {
+    _activeLogDay = dayFile.readString().toInt();
+    dayFile.close();
   }
 
   return true; // We continue even if SD fails
 }
 
+void SettingsManager::loop() {
+  _logWriter.loop();
+
+  // Day rollover check; needs NTP time (see connectToWiFi)
+  if (millis() - _lastRotationCheck < 60000) return;
+  _lastRotationCheck = millis();
+
+  time_t now = time(nullptr);
+  if (now < MIN_VALID_EPOCH) return; // Clock not set yet
+  struct tm tmNow;
+  localtime_r(&now, &tmNow);
+  uint32_t today = (tmNow.tm_year + 1900) * 10000 + (tmNow.tm_mon + 1) * 100 + tmNow.tm_mday;
+  if (today != _activeLogDay) rotateLogs(today);
+}
+
+void SettingsManager::rotateLogs(uint32_t today) {
+  if (_activeLogDay != 0) {
+    _logWriter.closeFiles();
+
+    // The LittleFS copy holds exactly the day being sealed. The SD CSV is
+    // the long-lived full log (/download_logs, Range and tail pulls) and is
+    // never cut here.
+    DaySummary summary;
+    if (LogArchive::sealDay(LittleFS, _logFilename, archiveFs(), _activeLogDay, summary)) {
+      Serial.printf("LOG: Sealed %u: %u sales, $%.2f, %u -> %u bytes\n", _activeLogDay,
+                    summary.count, summary.revenueCents / 100.0, summary.rawBytes,
+                    summary.segmentBytes);
+      // Segment and index are flushed and closed by now
+      LittleFS.remove(_logFilename);
+      if (!_sdAvailable) {
+        int pruned = LogArchive::prune(LittleFS, ARCHIVE_FLASH_MAX_DAYS);
+        if (pruned) Serial.printf("LOG: Pruned %d old segments from flash\n", pruned);
+      }
+    }
+  }
+
+  _activeLogDay = today;
+  File dayFile = LittleFS.open(_logDayFilename, "w");
+  if (dayFile) {
+    dayFile.print(_activeLogDay);
+    dayFile.close();
+  }
+}
+
+String SettingsManager::getHistoryJson(uint32_t fromDay, uint32_t toDay) {
+  return LogArchive::summariesJson(archiveFs(), fromDay, toDay);
+}
+
+File SettingsManager::openArchive(uint32_t day) {
+  String path = LogArchive::segmentPath(day);
+  if (!archiveFs().exists(path)) return File();
+  return archiveFs().open(path, "r");
+}
+
 bool SettingsManager::saveSettings(PaymentSettings settings[], int size) {
   StaticJsonDocument<2048> doc;
   JsonArray arr = doc.createNestedArray("payments");
@@ -128,26 +196,22 @@ bool SettingsManager::loadSettings(PaymentSettings settings[], int size) {
   return true;
 }
 
-void SettingsManager::addLog(float amount, int duration, String ref) {
-  // Log to LittleFS (Internal)
-  File file = LittleFS.open(_logFilename, "a");
-  if (file) {
-    file.printf("%.2f,%d,%s\n", amount, duration / 1000, ref.c_str());
-    file.close();
-  }
-
-  // Log to SD (External)
-  if (_sdAvailable) {
-    File sdFile = SD.open(_sdLogFilename, FILE_APPEND);
-    if (sdFile) {
-      sdFile.printf("%.2f,%d,%s\n", amount, duration / 1000, ref.c_str());
-      sdFile.flush(); // Ensure data is physically written
-      sdFile.close();
-    }
-  }
+void SettingsManager::addLog(float amount, int duration, String ref, int mode) {
+  // Buffered: reaches LittleFS (Internal) and SD (External) on the next commit
+  // Columns: amount,seconds|pulses,ref,epoch,T|C (epoch 0 if clock unset)
+  time_t now = time(nullptr);
+  if (now < MIN_VALID_EPOCH) now = 0;
+  int value = (mode == 1) ? duration : duration / 1000;
+  char line[112];
+  int len = snprintf(line, sizeof(line), "%.2f,%d,%s,%lu,%c\n", amount, value, ref.c_str(),
+                     (unsigned long)now, mode == 1 ? 'C' : 'T');
+  if (len <= 0) return;
+  if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+  _logWriter.append(line, len);
 }
 
 String SettingsManager::getLogs() {
+  _logWriter.flush();
   if (!LittleFS.exists(_logFilename))
     return "";
   File file = LittleFS.open(_logFilename, "r");
@@ -159,23 +223,21 @@ String SettingsManager::getLogs() {
 }
 
 void SettingsManager::clearLogs() {
+  _logWriter.closeFiles();
   if (LittleFS.exists(_logFilename)) {
     LittleFS.remove(_logFilename);
   }
 }
 
-String SettingsManager::getSdLogs() {
+File SettingsManager::openSdLogs() {
+  _logWriter.flush();
   if (!_sdAvailable || !SD.exists(_sdLogFilename))
-    return "";
-  File file = SD.open(_sdLogFilename, FILE_READ);
-  if (!file)
-    return "";
-  String content = file.readString();
-  file.close();
-  return content;
+    return File();
+  return SD.open(_sdLogFilename, FILE_READ);
 }
 
 void SettingsManager::clearSdLogs() {
+  _logWriter.closeFiles();
   if (_sdAvailable && SD.exists(_sdLogFilename)) {
     SD.remove(_sdLogFilename);
   }
@@ -183,6 +245,7 @@ void SettingsManager::clearSdLogs() {
 
 String SettingsManager::listSdDir(String path) {
   if (!_sdAvailable) return "[]";
+  if (path == "/ads") return adManifest.toJson();
   File root = SD.open(path);
   if (!root || !root.isDirectory()) return "[]";
   
@@ -201,11 +264,18 @@ String SettingsManager::listSdDir(String path) {
 
 bool SettingsManager::deleteSdFile(String path) {
   if (!_sdAvailable) return false;
-  return SD.remove(path);
+  if (!SD.remove(path)) return false;
+  if (path.startsWith("/ads/")) {
+    String name = path.substring(5);
+    adManifest.onFileRemoved(name);
+    SD.remove(AdManifest::thumbnailPath(name));
+  }
+  return true;
 }
 
 size_t SettingsManager::getDirSize(String path) {
   if (!_sdAvailable) return 0;
+  if (path == "/ads") return adManifest.totalBytes();
   File root = SD.open(path);
   if (!root || !root.isDirectory()) return 0;
   
@@ -6,6 +6,12 @@
 #include <LittleFS.h>
 #include <SD.h>
 #include <SPI.h>
+#include "AdManifest.h"
+#include "LogArchive.h"
+#include "LogWriter.h"
+
+// Anything earlier means the clock has not been set (no NTP yet)
+#define MIN_VALID_EPOCH 1577836800 // 2020-01-01
 
 struct PaymentSettings {
   float amount;
@@ -16,20 +22,29 @@ class SettingsManager {
 public:
   SettingsManager();
   bool begin();
+  void loop(); // Commits buffered log records, rotates at local midnight
   bool saveSettings(PaymentSettings settings[], int size);
   bool loadSettings(PaymentSettings settings[], int size);
-  void addLog(float amount, int duration, String ref);
+  // mode 0: Time (duration in ms), 1: Credit (duration = pulses)
+  void addLog(float amount, int duration, String ref, int mode = 0);
   String getLogs();
   void clearLogs();
   
-  String getSdLogs();
+  File openSdLogs(); // Caller streams and closes; empty File if unavailable
   void clearSdLogs();
+  const LogWriter::Stats &getLogStats() const { return _logWriter.getStats(); }
+  size_t getLogPending() const { return _logWriter.pending(); } // Bytes not yet committed
   bool isSdAvailable() { return _sdAvailable; }
 
+  // Daily archives (see LogArchive.h)
+  String getHistoryJson(uint32_t fromDay, uint32_t toDay);
+  File openArchive(uint32_t day);
+
   // New Image Management Methods
   String listSdDir(String path);
   bool deleteSdFile(String path);
   size_t getDirSize(String path);
+  AdManifest adManifest; // Cached /ads listing (see AdManifest.h)
 
   String adminUser = "admin";
   // Default hash for "admin" is:
@@ -64,8 +79,15 @@ private:
   const char *_filename = "/settings.json";
   const char *_logFilename = "/logs.csv";
   const char *_sdLogFilename = "/logs_sd.csv";
+  const char *_logDayFilename = "/log_day"; // Day the active logs belong to
   bool _sdAvailable = false;
   SPIClass _sdSPI;
+  LogWriter _logWriter;
+  uint32_t _activeLogDay = 0;
+  unsigned long _lastRotationCheck = 0;
+
+  fs::FS &archiveFs() { return _sdAvailable ? (fs::FS &)SD : (fs::FS &)LittleFS; }
+  void rotateLogs(uint32_t today);
 };
 
 #endif
@@ -1,4 +1,33 @@
 #include "SoundManager.h"
+#include <HTTPClient.h>
+#include <LittleFS.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+#define TTS_URL "https://translate.google.com/translate_tts?ie=UTF-8&tl=es&client=tw-ob&q="
+
+struct PromptInfo {
+    const char *name; // File name in SOUND_DIR
+    const char *text; // URL-encoded TTS text
+};
+
+static const PromptInfo prompts[SND_PROMPT_COUNT] = {
+    {"startup", "Sistema%20Iniciado"},
+    {"qr", "QR%20generado"},
+    {"activated", "Servicio%20activado"},
+    {"success", "Pago%20Aprobado"},
+    {"warning", "Un%20minuto%20restante"},
+    {"error", "Error"},
+};
+
+static ToneSynth *streamSynth = nullptr;
+
+// ESP32-audioI2S calls this for every stereo frame just before it goes to
+// I2S; UI sounds are mixed over whatever prompt is playing
+void audio_process_i2s(uint32_t *sample, bool *continueI2S) {
+    if (streamSynth) streamSynth->mix((int16_t *)sample, 1, streamSynth->streamRate());
+    *continueI2S = true;
+}
 
 SoundManager::SoundManager() {}
 
@@ -8,36 +37,158 @@ void SoundManager::begin() {
     
     // Set Volume (0-21)
     audio.setVolume(21); // Max volume
+
+    if (_synth.begin(I2S_PORT)) streamSynth = &_synth;
+    else Serial.println("Sound: synth task failed to start");
+
+    if (!LittleFS.exists(SOUND_DIR)) LittleFS.mkdir(SOUND_DIR);
+    // Left by a transfer cut short by a reset
+    LittleFS.remove(SOUND_TMP);
+    LittleFS.remove(SOUND_FETCH_TMP);
+    uint32_t cached = 0;
+    for (int i = 0; i < SND_PROMPT_COUNT; i++) {
+        File f = LittleFS.open(path((SoundPrompt)i), "r");
+        if (f && f.size() > 0) cached |= 1u << i;
+    }
+    _cached = cached;
+    Serial.printf("Sound: %d/%d prompts cached\n", __builtin_popcount(cached), SND_PROMPT_COUNT);
 }
 
 void SoundManager::loop() {
     audio.loop();
+    _synth.setStreaming(audio.isRunning(), audio.getSampleRate());
+
+    // Fill the cache while idle, off the loop: a download with no uplink
+    // can take the whole timeout plus the TLS connect
+    const uint32_t all = (1u << SND_PROMPT_COUNT) - 1;
+    if (_fetchTask || _cached == all || audio.isRunning() || WiFi.status() != WL_CONNECTED) return;
+    if ((int32_t)(millis() - _nextFetchMs) < 0) return;
+    TaskHandle_t task = nullptr;
+    if (xTaskCreatePinnedToCore(fetchTaskEntry, "snd_fetch", SOUND_FETCH_STACK, this, 1, &task, 0) == pdPASS) {
+        _fetchTask = task;
+    } else {
+        _nextFetchMs = millis() + SOUND_FETCH_RETRY_MS;
+    }
+}
+
+// One pass over the missing prompts; stops at the first failure
+void SoundManager::fetchTaskEntry(void *arg) {
+    SoundManager *self = (SoundManager *)arg;
+    for (int i = 0; i < SND_PROMPT_COUNT; i++) {
+        if (self->isCached((SoundPrompt)i)) continue;
+        if (!self->fetch((SoundPrompt)i)) {
+            self->_nextFetchMs = millis() + SOUND_FETCH_RETRY_MS;
+            break;
+        }
+    }
+    self->_fetchTask = nullptr;
+    vTaskDelete(NULL);
+}
+
+String SoundManager::path(SoundPrompt p) {
+    return String(SOUND_DIR "/") + prompts[p].name + ".mp3";
+}
+
+void SoundManager::play(SoundPrompt p) {
+    _synth.setStreaming(true, 0); // Stop idle writes before the library takes I2S
+    if (isCached(p)) {
+        _played[0]++;
+        audio.connecttoFS(LittleFS, path(p).c_str());
+    } else if (WiFi.status() == WL_CONNECTED) {
+        _played[1]++;
+        audio.connecttohost((String(TTS_URL) + prompts[p].text).c_str());
+    }
+}
+
+bool SoundManager::fetch(SoundPrompt p) {
+    WiFiClientSecure client;
+    client.setInsecure();
+    HTTPClient http;
+    http.setTimeout(SOUND_FETCH_TIMEOUT_MS);
+    http.begin(client, String(TTS_URL) + prompts[p].text);
+    int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        Serial.printf("Sound: fetching %s failed (%d)\n", prompts[p].name, code);
+        http.end();
+        return false;
+    }
+
+    // Written aside and renamed, so a half file is never played
+    File f = LittleFS.open(SOUND_FETCH_TMP, "w");
+    int written = f ? http.writeToStream(&f) : -1;
+    if (f) f.close();
+    http.end();
+
+    if (written <= 0 || !install(p, SOUND_FETCH_TMP)) {
+        Serial.printf("Sound: saving %s failed (%d)\n", prompts[p].name, written);
+        LittleFS.remove(SOUND_FETCH_TMP);
+        return false;
+    }
+    Serial.printf("Sound: cached %s (%d bytes)\n", prompts[p].name, written);
+    return true;
+}
+
+int SoundManager::findPrompt(const String &name) {
+    for (int i = 0; i < SND_PROMPT_COUNT; i++) {
+        if (name == prompts[i].name) return i;
+    }
+    return -1;
+}
+
+// Called from the loop (uploads) and the fetch task, hence the atomics
+bool SoundManager::install(SoundPrompt p, const char *tmp) {
+    String dest = path(p);
+    LittleFS.remove(dest);
+    if (!LittleFS.rename(tmp, dest.c_str())) {
+        __atomic_fetch_and(&_cached, ~(1u << p), __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_fetch_or(&_cached, 1u << p, __ATOMIC_RELAXED);
+    return true;
+}
+
+void SoundManager::forget(SoundPrompt p) {
+    LittleFS.remove(path(p));
+    __atomic_fetch_and(&_cached, ~(1u << p), __ATOMIC_RELAXED);
+    _nextFetchMs = millis();
+}
+
+String SoundManager::toJson() const {
+    String json = "{\"prompts\":[";
+    for (int i = 0; i < SND_PROMPT_COUNT; i++) {
+        if (i) json += ",";
+        json += "{\"name\":\"" + String(prompts[i].name) + "\",\"cached\":" + (isCached((SoundPrompt)i) ? "true" : "false") + "}";
+    }
+    json += "],\"playedLocal\":" + String(_played[0]) + ",\"playedStream\":" + String(_played[1]);
+    json += ",\"synth\":{\"triggers\":" + String(_synth.triggers()) + ",\"idleBlocks\":" + String(_synth.idleBlocks()) +
+            ",\"mixedFrames\":" + String(_synth.mixedFrames()) + "}}";
+    return json;
 }
 
 void SoundManager::playStartupSound() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=Sistema%20Iniciado&tl=es&client=tw-ob");
+    play(SND_STARTUP);
 }
 
 void SoundManager::playClick() {
-    // Emptied to remove button click lag as requested by user.
+    _synth.trigger(SYNTH_CLICK); // Synthesized; the TTS fetch here caused button lag
 }
 
 void SoundManager::playQrGenerated() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=QR%20generado&tl=es&client=tw-ob");
+    play(SND_QR_GENERATED);
 }
 
 void SoundManager::playServiceActivated() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=Servicio%20activado&tl=es&client=tw-ob");
+    play(SND_SERVICE_ACTIVATED);
 }
 
 void SoundManager::playSuccess() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=Pago%20Aprobado&tl=es&client=tw-ob");
+    play(SND_SUCCESS);
 }
 
 void SoundManager::playWarning() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=Un%20minuto%20restante&tl=es&client=tw-ob");
+    play(SND_WARNING);
 }
 
 void SoundManager::playError() {
-    audio.connecttohost("https://translate.google.com/translate_tts?ie=UTF-8&q=Error&tl=es&client=tw-ob");
+    play(SND_ERROR);
 }
@@ -2,18 +2,43 @@
 #define SOUND_MANAGER_H
 
 #include <Arduino.h>
-#include "Audio.h" // Requires 'ESP32-audioI2S' library by Schreibfaul1
+#include "Audio.h" // Requires 'ESP32-audioI2S' library by Schreibfaul1 (2.0.x, legacy I2S driver)
+#include "ToneSynth.h"
 
 // Default Pin mapping for JC3248W535 (Guition ESP32-S3 3.5" with Audio)
 // Confirmed Pinout: BCLK=42, LRC=2, DOUT=41
 #define I2S_BCLK_PIN 42
 #define I2S_LRC_PIN  2
 #define I2S_DOUT_PIN 41 
+#define I2S_PORT 0 // Audio's default port; ToneSynth writes to it when idle
+
+// Voice prompts are MP3 files in LittleFS, /snd/<name>.mp3. Missing ones are
+// streamed from Google TTS when played and downloaded by a short-lived task
+// on core 0 (started from loop() while nothing is playing, so the loop
+// never waits on TLS or a dead uplink), so after the first boot
+// online every prompt starts from flash with no network at all. A file can
+// also be replaced with a recorded MP3 through /api/sounds.
+#define SOUND_DIR "/snd"
+#define SOUND_TMP SOUND_DIR "/upload.tmp"      // /api/sounds uploads
+#define SOUND_FETCH_TMP SOUND_DIR "/fetch.tmp" // Downloads, written by the fetch task
+#define SOUND_FETCH_RETRY_MS 60000 // After a failed download
+#define SOUND_FETCH_TIMEOUT_MS 8000
+#define SOUND_FETCH_STACK 8192     // TLS handshake
+
+enum SoundPrompt {
+    SND_STARTUP,
+    SND_QR_GENERATED,
+    SND_SERVICE_ACTIVATED,
+    SND_SUCCESS,
+    SND_WARNING,
+    SND_ERROR,
+    SND_PROMPT_COUNT
+};
 
 class SoundManager {
 public:
     SoundManager();
-    void begin();
+    void begin(); // After LittleFS is mounted
     void playStartupSound();
     void loop(); // Must be called in main loop
     
@@ -23,11 +48,28 @@ public:
     void playSuccess();
     void playWarning();
     void playError();
+    void playTone(SynthSound s) { _synth.trigger(s); } // Any task, microseconds
+
+    bool isCached(SoundPrompt p) const { return _cached & (1u << p); }
+    static int findPrompt(const String &name); // -1 if unknown
+    bool install(SoundPrompt p, const char *tmp = SOUND_TMP); // Moves tmp into place
+    void forget(SoundPrompt p);  // Deleted, downloaded again when online
+    String toJson() const;
     
     Audio* getAudio() { return &audio; }
 
 private:
+    void play(SoundPrompt p);
+    bool fetch(SoundPrompt p);
+    static void fetchTaskEntry(void *arg);
+    static String path(SoundPrompt p);
+
     Audio audio;
+    ToneSynth _synth;
+    volatile uint32_t _cached = 0; // Bit per SoundPrompt present in LittleFS
+    volatile uint32_t _nextFetchMs = 0;
+    TaskHandle_t volatile _fetchTask = nullptr; // Set while a download pass runs
+    uint32_t _played[2] = {0, 0}; // From flash, streamed
 };
 
 #endif
@@ -0,0 +1,144 @@
+#include "ToneSynth.h"
+#include <driver/i2s.h>
+#include <math.h>
+
+bool ToneSynth::begin(int i2sPort) {
+  _port = i2sPort;
+  for (int i = 0; i < (1 << SYNTH_SINE_BITS); i++) {
+    _sine[i] = (int16_t)lroundf(32767.0f * sinf(2.0f * (float)M_PI * i / (1 << SYNTH_SINE_BITS)));
+  }
+  // Noise under a fast exponential decay; a fixed seed keeps every click identical
+  uint32_t seed = 0x2545F491;
+  const int n = sizeof(_click) / sizeof(_click[0]);
+  for (int i = 0; i < n; i++) {
+    seed = seed * 1664525 + 1013904223;
+    float env = expf(-6.0f * i / n);
+    _click[i] = (int16_t)(((int32_t)(seed >> 16) - 32768) * env);
+  }
+
+  return xTaskCreatePinnedToCore(taskEntry, "synth", SYNTH_TASK_STACK, this, SYNTH_TASK_PRIORITY, &_task, 0) == pdPASS;
+}
+
+void ToneSynth::trigger(SynthSound s) {
+  _pending.fetch_or(1u << s, std::memory_order_release);
+  _triggers.fetch_add(1, std::memory_order_relaxed);
+  if (_task) xTaskNotifyGive(_task);
+}
+
+void ToneSynth::setStreaming(bool on, uint32_t rate) {
+  if (rate) _streamRate = rate;
+  if (on == _streaming) return;
+  _streaming = on;
+  // Voices that were waiting on the stream go out through I2S again
+  if (!on && _task) xTaskNotifyGive(_task);
+}
+
+void ToneSynth::startVoice(const int16_t *table, uint16_t freq, uint16_t ms, uint16_t delayMs, int16_t level,
+                           uint32_t rate) {
+  int slot = 0;
+  for (int i = 0; i < SYNTH_VOICES; i++) {
+    if (!_voices[i].table) { slot = i; break; }
+    if (_voices[i].frames < _voices[slot].frames) slot = i; // Steal the one closest to done
+  }
+  Voice &v = _voices[slot];
+  if (!v.table) _active++;
+  v.table = table;
+  v.freq = freq;
+  v.frames = (uint32_t)ms * rate / 1000;
+  v.delay = (uint32_t)delayMs * rate / 1000;
+  v.phase = 0;
+  if (freq) {
+    v.mask = (1 << SYNTH_SINE_BITS) - 1;
+    v.step = (uint32_t)(((uint64_t)freq << 32) / rate);
+    v.length = 0;
+  } else {
+    v.mask = 0;
+    v.length = sizeof(_click) / sizeof(_click[0]);
+    v.step = ((uint32_t)SYNTH_RATE << 16) / rate;
+  }
+  v.gain = level;
+  v.gainStep = v.frames ? (level + v.frames - 1) / v.frames : level;
+}
+
+void ToneSynth::startPending(uint32_t rate) {
+  uint32_t bits = _pending.exchange(0, std::memory_order_acquire);
+  if (bits & (1u << SYNTH_CLICK)) startVoice(_click, 0, SYNTH_CLICK_MS, 0, 20000, rate);
+  if (bits & (1u << SYNTH_BEEP)) startVoice(_sine, 1000, 60, 0, 12000, rate);
+  if (bits & (1u << SYNTH_CONFIRM)) {
+    startVoice(_sine, 880, 90, 0, 11000, rate);
+    startVoice(_sine, 1320, 140, 80, 11000, rate);
+  }
+  if (bits & (1u << SYNTH_ERROR)) startVoice(_sine, 220, 250, 0, 14000, rate);
+}
+
+void ToneSynth::render(int16_t *stereo, int frames, uint32_t rate) {
+  if (_pending.load(std::memory_order_relaxed)) startPending(rate);
+  for (int i = 0; i < SYNTH_VOICES && _active; i++) {
+    Voice &v = _voices[i];
+    if (!v.table) continue;
+    int16_t *out = stereo;
+    for (int f = 0; f < frames; f++, out += 2) {
+      if (v.delay) { v.delay--; continue; }
+      int32_t s;
+      if (v.mask) {
+        s = v.table[(v.phase >> (32 - SYNTH_SINE_BITS)) & v.mask];
+      } else {
+        uint32_t idx = v.phase >> 16;
+        if (idx >= v.length) { v.frames = 0; break; }
+        s = v.table[idx];
+      }
+      v.phase += v.step;
+      s = (s * v.gain) >> 15;
+      int32_t l = out[0] + s, r = out[1] + s;
+      out[0] = l > 32767 ? 32767 : l < -32768 ? -32768 : l;
+      out[1] = r > 32767 ? 32767 : r < -32768 ? -32768 : r;
+      v.gain -= v.gainStep;
+      if (--v.frames == 0 || v.gain <= 0) { v.frames = 0; break; }
+    }
+    if (v.frames == 0 && !v.delay) {
+      v.table = nullptr;
+      _active--;
+    }
+  }
+}
+
+void ToneSynth::mix(int16_t *stereo, int frames, uint32_t rate) {
+  if (!busy() || _rendering.test_and_set(std::memory_order_acquire)) return;
+  render(stereo, frames, rate);
+  _mixedFrames += frames;
+  _rendering.clear(std::memory_order_release);
+}
+
+void ToneSynth::taskEntry(void *arg) {
+  ToneSynth *self = (ToneSynth *)arg;
+  static int16_t block[SYNTH_BLOCK * 2];
+  bool bursting = false;
+
+  for (;;) {
+    if (self->_streaming || !self->busy()) {
+      // No zeroing here: i2s_write returns once the block is queued, so the
+      // DMA ring still holds the sound. The library installs the driver with
+      // tx_desc_auto_clear, which plays silence once the ring runs dry.
+      bursting = false;
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    if (!bursting) {
+      // The audio library leaves the port at its last stream's rate
+      i2s_set_sample_rates((i2s_port_t)self->_port, SYNTH_RATE);
+      bursting = true;
+    }
+
+    memset(block, 0, sizeof(block));
+    if (self->_rendering.test_and_set(std::memory_order_acquire)) {
+      vTaskDelay(1);
+      continue;
+    }
+    self->render(block, SYNTH_BLOCK, SYNTH_RATE);
+    self->_rendering.clear(std::memory_order_release);
+
+    size_t written;
+    i2s_write((i2s_port_t)self->_port, block, sizeof(block), &written, pdMS_TO_TICKS(50));
+    self->_idleBlocks++;
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef TONE_SYNTH_H
+#define TONE_SYNTH_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Short UI sounds rendered from PCM tables in internal RAM. trigger() only
+// sets a bit and notifies the synth task, so it costs a few microseconds and
+// is safe from the UI and touch tasks. Voices are rendered either into the
+// prompt that is playing (mix(), from the audio library's per-frame hook) or,
+// when nothing plays, by the synth task straight into the I2S DMA queue.
+#define SYNTH_RATE 22050     // Idle output rate
+#define SYNTH_VOICES 4
+#define SYNTH_BLOCK 128      // Frames per idle I2S write (~6 ms)
+#define SYNTH_SINE_BITS 8    // 256-entry sine table
+#define SYNTH_CLICK_MS 4
+#define SYNTH_TASK_STACK 2048
+#define SYNTH_TASK_PRIORITY 2
+
+enum SynthSound : uint8_t {
+  SYNTH_CLICK,   // Key press: decaying noise burst
+  SYNTH_BEEP,    // Short 1 kHz blip
+  SYNTH_CONFIRM, // Rising two-note chime
+  SYNTH_ERROR,   // Low buzz
+  SYNTH_SOUND_COUNT
+};
+
+class ToneSynth {
+public:
+  bool begin(int i2sPort); // Builds the tables and starts the idle task
+  void trigger(SynthSound s);
+
+  // Adds active voices to `frames` interleaved stereo frames at `rate`. Does
+  // nothing if another context is rendering right now.
+  void mix(int16_t *stereo, int frames, uint32_t rate);
+  bool busy() const { return _active || _pending.load(std::memory_order_relaxed); }
+
+  // Set while the audio library owns I2S; voices then ride on its stream
+  void setStreaming(bool on, uint32_t rate);
+  uint32_t streamRate() const { return _streamRate; }
+
+  uint32_t triggers() const { return _triggers.load(std::memory_order_relaxed); }
+  uint32_t idleBlocks() const { return _idleBlocks; }
+  uint32_t mixedFrames() const { return _mixedFrames; }
+
+private:
+  struct Voice {
+    const int16_t *table; // nullptr when free
+    uint32_t mask;        // Looping table: index mask; one-shot: 0
+    uint32_t length;      // One-shot length in table samples
+    uint32_t phase;       // Looping: 8.24 index; one-shot: 16.16
+    uint32_t step;
+    int32_t gain;         // Q15
+    int32_t gainStep;     // Subtracted per frame
+    uint32_t delay;       // Frames before it starts
+    uint32_t frames;      // Frames left once started
+    uint16_t freq;        // Tone frequency, 0 for PCM
+  };
+
+  static void taskEntry(void *arg);
+  void startPending(uint32_t rate);
+  void startVoice(const int16_t *table, uint16_t freq, uint16_t ms, uint16_t delayMs, int16_t level, uint32_t rate);
+  void render(int16_t *stereo, int frames, uint32_t rate);
+
+  int16_t _sine[1 << SYNTH_SINE_BITS];
+  int16_t _click[SYNTH_RATE * SYNTH_CLICK_MS / 1000];
+  Voice _voices[SYNTH_VOICES] = {};
+  uint8_t _active = 0; // Voices in use, owned by whoever holds _rendering
+
+  std::atomic<uint32_t> _pending{0}; // Bit per SynthSound
+  std::atomic_flag _rendering = ATOMIC_FLAG_INIT;
+  volatile bool _streaming = false;
+  volatile uint32_t _streamRate = SYNTH_RATE;
+  int _port = 0;
+  TaskHandle_t _task = nullptr;
+
+  std::atomic<uint32_t> _triggers{0};
+  volatile uint32_t _idleBlocks = 0;
+  volatile uint32_t _mixedFrames = 0;
+};
+
+#endif
@@ -15,6 +15,13 @@ const char *GOOGLE_SCRIPT_URL = "https://script.google.com/macros/s/"
                                 "AKfycbyXry0AVjUcz0V9VGMNM1sDmUS8l1vqD5BMYUx6or"
                                 "daEShoUYLVAVvsaIZ2YHPe230n0A/exec";
 
+// Time Sync (log timestamps and daily rotation at local midnight)
+const long TZ_OFFSET_SEC = -3 * 3600; // Argentina (UTC-3)
+const char *NTP_SERVER = "pool.ntp.org";
+
+// Ads storage on SD
+const uint64_t ADS_QUOTA_BYTES = 400ULL * 1024 * 1024;
+
 // Mercado Pago Credentials (To be filled by user)
 // Get your Access Token from: https://www.mercadopago.com.ar/developers/panel
 const char *MP_ACCESS_TOKEN =
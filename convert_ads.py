@@ -1,26 +1,122 @@
-from PIL import Image
+import argparse
 import os
+import struct
+import sys
+
+from PIL import Image
+
+# Batch converter for ad images. The default output is the raw .565 format
+# the device loads with plain sequential SD reads (see AdRawHeader in
+# AdDecoder.h); --jpeg keeps the old JPEG output.
+#   python convert_ads.py ads_src/ -o ads/ --rle
+#   python convert_ads.py promo.png welcome.jpg -o ads/
+
+WIDTH, HEIGHT = 480, 320
+RAW_MAGIC = b"R565"
+RAW_VERSION = 1
+RAW_FLAG_RLE = 0x01
+IMAGE_EXTS = (".png", ".jpg", ".jpeg", ".bmp", ".gif", ".webp")
+
+
+def fit(img):
+    # Scale to cover 480x320 and center-crop, so every ad fills the screen
+    img = img.convert("RGB")
+    scale = max(WIDTH / img.width, HEIGHT / img.height)
+    size = (max(WIDTH, round(img.width * scale)), max(HEIGHT, round(img.height * scale)))
+    img = img.resize(size, Image.LANCZOS)
+    left = (img.width - WIDTH) // 2
+    top = (img.height - HEIGHT) // 2
+    return img.crop((left, top, left + WIDTH, top + HEIGHT))
+
+
+def to_rgb565(img):
+    return [((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3) for r, g, b in img.getdata()]
+
+
+def rle_encode(pixels):
+    out = bytearray()
+    literal = []
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:0x8000]
+            del literal[:0x8000]
+            out.extend(struct.pack("<H", len(chunk) - 1))
+            out.extend(struct.pack("<%dH" % len(chunk), *chunk))
 
-source_dir = r"C:/Users/user/.gemini/antigravity/brain/0164f848-9e1e-4f15-ad14-25e4343f9f8d"
-dest_dir = r"c:/Users/user/Documents/qrsoloenesp/ads"
-
-images = [
-    ("ad_welcome_1769430589707.png", "ad1.jpg"),
-    ("ad_promo_1769430609964.png", "ad2.jpg"),
-    ("ad_instructions_1769430630770.png", "ad3.jpg")
-]
-
-for src_name, dest_name in images:
-    try:
-        src_path = os.path.join(source_dir, src_name)
-        dest_path = os.path.join(dest_dir, dest_name)
-        
-        if os.path.exists(src_path):
-            img = Image.open(src_path)
-            rgb_img = img.convert('RGB')
-            rgb_img.save(dest_path, "JPEG", quality=90)
-            print(f"Converted {src_name} to {dest_path}")
+    i = 0
+    n = len(pixels)
+    while i < n:
+        run = 1
+        while i + run < n and run < 0x8000 and pixels[i + run] == pixels[i]:
+            run += 1
+        if run >= 3:
+            flush_literal()
+            out.extend(struct.pack("<HH", 0x8000 | (run - 1), pixels[i]))
         else:
-            print(f"Source not found: {src_path}")
-    except Exception as e:
-        print(f"Error converting {src_name}: {e}")
+            literal.extend(pixels[i:i + run])
+        i += run
+    flush_literal()
+    return bytes(out)
+
+
+def write_raw(img, dest_path, rle):
+    pixels = to_rgb565(img)
+    payload = struct.pack("<%dH" % len(pixels), *pixels)
+    flags = 0
+    if rle:
+        packed = rle_encode(pixels)
+        # Keep RLE only when it actually saves space
+        if len(packed) < len(payload):
+            payload = packed
+            flags |= RAW_FLAG_RLE
+    header = RAW_MAGIC + struct.pack("<HHBBHI", WIDTH, HEIGHT, RAW_VERSION, flags, 0, len(payload))
+    with open(dest_path, "wb") as f:
+        f.write(header)
+        f.write(payload)
+    return flags
+
+
+def collect(inputs):
+    for path in inputs:
+        if os.path.isdir(path):
+            for name in sorted(os.listdir(path)):
+                if name.lower().endswith(IMAGE_EXTS):
+                    yield os.path.join(path, name)
+        else:
+            yield path
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert ad images for the QR display (480x320).")
+    parser.add_argument("inputs", nargs="+", help="Image files or directories")
+    parser.add_argument("-o", "--output", default="ads", help="Output directory (default: ads)")
+    parser.add_argument("--rle", action="store_true", help="RLE-compress .565 output when smaller")
+    parser.add_argument("--jpeg", action="store_true", help="Write JPEG instead of .565")
+    parser.add_argument("--quality", type=int, default=90, help="JPEG quality (default: 90)")
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+    failed = 0
+    for src_path in collect(args.inputs):
+        base = os.path.splitext(os.path.basename(src_path))[0]
+        try:
+            img = fit(Image.open(src_path))
+            if args.jpeg:
+                dest_path = os.path.join(args.output, base + ".jpg")
+                img.save(dest_path, "JPEG", quality=args.quality)
+                kind = "jpeg"
+            else:
+                dest_path = os.path.join(args.output, base + ".565")
+                flags = write_raw(img, dest_path, args.rle)
+                kind = "565+rle" if flags & RAW_FLAG_RLE else "565"
+            print("%s -> %s (%s, %d bytes)" % (src_path, dest_path, kind, os.path.getsize(dest_path)))
+        except Exception as e:
+            failed += 1
+            print("Error converting %s: %s" % (src_path, e))
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+import struct
+import sys
+
+# Decodes the daily log archives written by LogArchive (see LogArchive.h).
+#   python decode_archive.py 20260115.seg      -> CSV rows (same columns as logs.csv)
+#   python decode_archive.py summary.bin       -> one line of totals per day
+
+SUMMARY_FORMAT = "<IIIIIHHII"  # struct DaySummary (packed, 32 bytes)
+
+
+def read_varint(data, pos):
+    result = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        result |= (b & 0x7F) << shift
+        if b < 0x80:
+            return result, pos
+        shift += 7
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def decode_segment(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data[:4] != b"QRSG":
+        raise ValueError("Not an archive segment: " + path)
+    version, = struct.unpack_from("<B", data, 4)
+    day, count = struct.unpack_from("<II", data, 8)
+    if version != 1:
+        raise ValueError("Unsupported segment version %d" % version)
+
+    print("# day=%d records=%d" % (day, count))
+    pos = 16
+    ts = 0
+    cents = 0
+    ref = b""
+    for _ in range(count):
+        v, pos = read_varint(data, pos)
+        ts += unzigzag(v)
+        v, pos = read_varint(data, pos)
+        cents += unzigzag(v)
+        v, pos = read_varint(data, pos)
+        value, mode = v >> 1, ("C" if v & 1 else "T")
+        shared, pos = read_varint(data, pos)
+        suffix_len, pos = read_varint(data, pos)
+        ref = ref[:shared] + data[pos:pos + suffix_len]
+        pos += suffix_len
+        print("%.2f,%d,%s,%d,%s" % (cents / 100.0, value, ref.decode("utf-8", "replace"), ts, mode))
+
+
+def decode_summary(path):
+    size = struct.calcsize(SUMMARY_FORMAT)
+    with open(path, "rb") as f:
+        data = f.read()
+
+    print("day,count,revenue,minutes,pulses,count_time,count_credit,segment_bytes,raw_bytes")
+    for off in range(0, len(data) - size + 1, size):
+        day, count, rev, minutes, pulses, ct, cc, seg, raw = struct.unpack_from(SUMMARY_FORMAT, data, off)
+        print("%d,%d,%.2f,%d,%d,%d,%d,%d,%d" % (day, count, rev / 100.0, minutes, pulses, ct, cc, seg, raw))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: python decode_archive.py <YYYYMMDD.seg | summary.bin> [...]")
+        sys.exit(1)
+
+    for path in sys.argv[1:]:
+        if path.endswith(".seg"):
+            decode_segment(path)
+        else:
+            decode_summary(path)
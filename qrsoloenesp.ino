@@ -11,7 +11,11 @@
 #include <mbedtls/aes.h>
 
 #include "DisplayManager.h" // Added DisplayManager
+#include "MemoryManager.h"
 #include "MercadoPagoClient.h"
+#include "PngEncoder.h"
+#include "Pricing.h"
+#include "SalesStats.h"
 #include "SettingsManager.h"
 #include "SoundManager.h" // Restored
 #include "config.h"
@@ -22,6 +26,7 @@ SettingsManager settingsManager;
 DNSServer dnsServer;
 DisplayManager display; // Added instance
 SoundManager soundManager; // Restored
+SalesStats salesStats;
 
 const int NUM_PAYMENTS = 3;
 PaymentSettings payments[NUM_PAYMENTS] = {
@@ -41,6 +46,8 @@ int pulsesToOutput = 0;
 unsigned long nextPulseAction = 0;
 bool pulseActive = false;
 int currentUnits = 0;
+bool currentPromoApplied = false;
+bool currentFromQr = false; // Payment started from a QR counted in salesStats
 
 // Variables para polling automático
 unsigned long lastPollTime = 0;
@@ -74,9 +81,12 @@ void onServiceActivation() {
         pulseActive = false;
         nextPulseAction = millis();
         Serial.println("Activated (Credit): " + String(currentUnits) + " pulses");
-        settingsManager.addLog(currentAmount, currentUnits, currentExternalRef);
+        settingsManager.addLog(currentAmount, currentUnits, currentExternalRef, 1);
     }
     
+    salesStats.recordSale((uint32_t)lround(currentAmount * 100), currentUnits, currentPromoApplied, currentFromQr);
+    currentFromQr = false; // One sale per generated QR
+
     // Log to Google Sheets (Non-blocking ideally, move to after for better UX)
     logToGoogleSheets(currentAmount, currentUnits, currentExternalRef);
     
@@ -100,6 +110,13 @@ void handlePaymentApproved() {
     display.showReady();
 }
 
+// Same rules the keypad uses for its total (no promo in fixed mode)
+PriceRules currentPriceRules() {
+    return PriceRules::fromSettings(settingsManager.pricePerUnit, settingsManager.operationMode,
+                                    settingsManager.promoEnabled, settingsManager.promoThreshold,
+                                    settingsManager.promoValue);
+}
+
 // Callback para solicitudes desde la pantalla TFT
 void onTftPaymentRequest(int units) {
     Serial.println("--- TFT Payment Request START ---");
@@ -112,31 +129,22 @@ void onTftPaymentRequest(int units) {
         return;
     }
 
-    currentUnits = units;
-    currentAmount = units * settingsManager.pricePerUnit;
-    currentExternalRef = "TFT_" + String(millis());
-    paymentConfirmed = false;
-
-    // --- PROMOTION LOGIC (Discount only) ---
-    if (settingsManager.operationMode != 2 && settingsManager.promoEnabled && units >= settingsManager.promoThreshold) {
-        Serial.println("Promotion Triggered! Applying discount...");
-        float discountFactor = (100.0 - settingsManager.promoValue) / 100.0;
-        currentAmount = currentAmount * discountFactor;
-        Serial.println("Discount Applied: " + String(settingsManager.promoValue) + "%. New Amount: $" + String(currentAmount));
-    }
-
     // --- FIXED QR LOGIC ---
     if (settingsManager.operationMode == 2) {
          Serial.println("Fixed QR Mode Active (TFT). Enforcing Fixed Units.");
          units = settingsManager.fixedUnits;
-         
-         // Update vars based on fixed units
-         currentUnits = units;
-         currentAmount = units * settingsManager.pricePerUnit;
-         
-         // For fixed mode, we might want to skip Promo logic or Apply it? 
-         // Usually Fixed Price implies NO promo, or promo is baked in. 
-         // Let's assume Fixed Mode is the "Preset" and we just pay that.
+    }
+
+    // --- PRICING (promo discount included, see Pricing.h) ---
+    PriceQuote quote = currentPriceRules().quote(units);
+    currentUnits = units;
+    currentAmount = PriceRules::toPesos(quote.totalCentavos);
+    currentExternalRef = "TFT_" + String(millis());
+    paymentConfirmed = false;
+    currentPromoApplied = quote.promoApplied;
+    currentFromQr = false;
+    if (quote.promoApplied) {
+        Serial.printf("Promotion Triggered! %.2f%% off. New Amount: $%.2f\n", settingsManager.promoValue, currentAmount);
     }
 
     String itemName = String(units) + (settingsManager.operationMode == 0 ? " Minutos" : " Creditos");
@@ -148,7 +156,9 @@ void onTftPaymentRequest(int units) {
 
     if (initPoint != "Error" && initPoint != "") {
         Serial.println("Rendering QR on TFT...");
-        display.showQR(initPoint, currentAmount);
+        display.showQR(initPoint.c_str(), currentAmount);
+        salesStats.recordQr();
+        currentFromQr = true;
         Serial.println("QR Rendered successfully.");
     } else {
         Serial.println("MP Error detected.");
@@ -183,7 +193,7 @@ void startAPMode() {
     Serial.println("Created /ads directory on SD");
   }
 
-  display.showAPInfo(ssid, pass, "http://" + apIP);
+  display.showAPInfo(ssid.c_str(), pass.c_str(), ("http://" + apIP).c_str());
 }
 
 void connectToWiFi() {
@@ -206,9 +216,9 @@ void connectToWiFi() {
     delay(500);
     Serial.print(".");
     dots = (dots + 1) % 4;
-    String dotsStr = "";
-    for (int i = 0; i < dots; i++) dotsStr += ".";
-    display.showStartup("Conectando a:\n" + ssid + "\n" + dotsStr);
+    char status[96];
+    snprintf(status, sizeof(status), "Conectando a:\n%s\n%.*s", ssid.c_str(), dots, "...");
+    display.showStartup(status);
     digitalWrite(PIN_LED, !digitalRead(PIN_LED));
     
     // Check if user still wants to force AP
@@ -226,8 +236,9 @@ void connectToWiFi() {
   if (WiFi.status() == WL_CONNECTED) {
     digitalWrite(PIN_LED, LOW);
     Serial.println("\nWiFi Connected! IP: " + WiFi.localIP().toString());
-    display.showConnectionSuccess(WiFi.localIP().toString(), "http://" + activeHostname + ".local");
+    display.showConnectionSuccess(WiFi.localIP().toString().c_str(), ("http://" + activeHostname + ".local").c_str());
     soundManager.playStartupSound(); // Play sound now that WiFi is ready
+    configTime(TZ_OFFSET_SEC, 0, NTP_SERVER); // Log timestamps + daily rotation
     // mDNS Setup again just in case IP changed
     if (MDNS.begin(activeHostname.c_str())) {
       MDNS.addService("http", "tcp", 80);
@@ -653,7 +664,7 @@ void handleAdmin() {
   html += "<div style='overflow-x:auto; margin-bottom:16px;'>";
   html += "<table "
           "id='log-table'><thead><tr><th>Monto</th><th>Duración</"
-          "th><th>Referencia</th></tr></thead><tbody "
+          "th><th>Referencia</th><th>Fecha</th><th>Modo</th></tr></thead><tbody "
           "id='log-body'></tbody></table>";
   html += "</div>";
   html += "<div class='grid-2'>";
@@ -739,9 +750,9 @@ void handleAdmin() {
 
   // Card: Advertising Carousel
   html += "<div class='card'><h3>📺 Publicidad y Carrusel</h3>";
-  html += "<p>Subir imágenes (JPG recomendadas). Máximo total 400MB.<br><strong>Nota:</strong> Solo JPEG, resolución obligatoria 480x320px.</p>";
+  html += "<p>Subir imágenes (JPG recomendadas). Máximo total 400MB.<br><strong>Nota:</strong> JPEG, PNG, .565 (convert_ads.py, carga más rápida) o video MJPEG/AVI, resolución recomendada 480x320px (los JPEG más grandes se reducen y centran).</p>";
   html += "<form action='/upload_ad' method='POST' enctype='multipart/form-data'>";
-  html += "<div class='input-group'><input type='file' name='adfile' accept='.jpg,.jpeg,.png,.bmp'></div>";
+  html += "<div class='input-group'><input type='file' name='adfile' accept='.jpg,.jpeg,.565,.mjpeg,.mjpg,.avi,.png,.bmp'></div>";
   html += "<button type='submit' class='btn btn-primary'>Subir Imagen</button>";
   html += "</form><hr>";
   html += "<div id='ad-list'>Cargando imágenes...</div>";
@@ -764,8 +775,10 @@ void handleAdmin() {
       "rows.reverse().forEach(row=>{ if(!row)return; const cols = "
       "row.split(','); const tr = document.createElement('tr'); "
       "tr.style.borderBottom='1px solid #333'; "
-      "cols.forEach(c=>{ const td = document.createElement('td'); "
-      "td.style.padding='12px 16px'; td.innerText=c; tr.appendChild(td); }); "
+      "cols.forEach((c,i)=>{ const td = document.createElement('td'); "
+      "td.style.padding='12px 16px'; "
+      "td.innerText=(i==3 && +c>0) ? new Date(c*1000).toLocaleString() : c; "
+      "tr.appendChild(td); }); "
       "body.appendChild(tr); }); }); }";
   html += "function exportLogs(){ "
           "fetch('/get_logs').then(r=>r.blob()).then(blob=>{ "
@@ -855,8 +868,8 @@ void handleAdmin() {
 
   html += "function exitAP() { if(confirm('¿Deseas conectar a WiFi y salir del modo configuración?')) { fetch('/exit_ap').then(r=>r.text()).then(t=>{ alert(t); }); }}";
   html += "function loadAds() { fetch('/list_ads').then(r=>r.json()).then(data=>{ "
-          "let h='<table class=\"table\"><tr><th>Archivo</th><th>Tamaño</th><th>Acción</th></tr>'; "
-          "data.forEach(f=>{ h+='<tr><td>'+f.name+'</td><td>'+(f.size/1024).toFixed(1)+'KB</td><td><button class=\"btn btn-danger btn-sm\" onclick=\"deleteAd(\\''+f.name+'\\')\">Borrar</button></td></tr>'; }); "
+          "let h='<table class=\"table\"><tr><th>Vista</th><th>Archivo</th><th>Tamaño</th><th>Acción</th></tr>'; "
+          "data.forEach(f=>{ h+='<tr><td><img src=\"/ad_thumb?name='+encodeURIComponent(f.name)+'&v='+f.mtime+'\" loading=\"lazy\" style=\"max-height:40px\" onerror=\"this.style.visibility=\\'hidden\\'\"></td><td>'+f.name+'</td><td>'+(f.size/1024).toFixed(1)+'KB</td><td><button class=\"btn btn-danger btn-sm\" onclick=\"deleteAd(\\''+f.name+'\\')\">Borrar</button></td></tr>'; }); "
           "h+='</table>'; document.getElementById('ad-list').innerHTML=h; }); } "
           "function deleteAd(name) { if(confirm('Borrar '+name+'?')) { fetch('/delete_ad?name='+name).then(r=>r.text()).then(t=>{ alert(t); loadAds(); }); }} ";
   html += "window.onload = function() { loadLogs(); loadAds(); };";
@@ -911,7 +924,7 @@ void handleSaveSettings() {
   display.setOperationMode(settingsManager.operationMode);
   display.setPromoConfig(settingsManager.promoEnabled, settingsManager.promoThreshold, settingsManager.promoType, settingsManager.promoValue);
   display.setFixedModeConfig(settingsManager.fixedUnits);
-  display.setStaticQrText(settingsManager.staticQrText);
+  display.setStaticQrText(settingsManager.staticQrText.c_str());
 
   server.sendHeader("Location", "/admin");
   server.send(302, "text/plain", "Saved");
@@ -966,12 +979,286 @@ void handleClearLogs() {
   server.send(200, "text/plain", "Internal Logs Cleared");
 }
 
+// Parses an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") into UTC epoch.
+// Returns 0 if the header is malformed.
+time_t parseHttpDate(const String &value) {
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char mon[4] = {0};
+  int day, year, hh, mm, ss;
+  if (sscanf(value.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, mon, &year, &hh, &mm, &ss) != 6)
+    return 0;
+  const char *pos = strstr(months, mon);
+  if (!pos || mon[0] == 0) return 0;
+  int m = (pos - months) / 3 + 1;
+
+  // Days from civil (proleptic Gregorian), avoids depending on the local TZ
+  int y = year - (m <= 2);
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  long days = (long)era * 146097 + doe - 719468;
+  return (time_t)(days * 86400L + hh * 3600L + mm * 60L + ss);
+}
+
+// Sends a log file in fixed-size chunks straight from the filesystem instead
+// of loading it into RAM. Honors "Range: bytes=..." (206) and
+// "If-Modified-Since" (304) so collection scripts can fetch only the tail
+// appended since their last pull.
+void streamLogFile(File &file, const char *contentType) {
+  size_t size = file.size();
+  time_t mtime = file.getLastWrite();
+  // FAT stamps everything written before NTP sync with the same default date
+  bool validTime = mtime > MIN_VALID_EPOCH;
+
+  char lastModified[32] = "";
+  if (validTime) {
+    struct tm tmUtc;
+    gmtime_r(&mtime, &tmUtc);
+    strftime(lastModified, sizeof(lastModified), "%a, %d %b %Y %H:%M:%S GMT", &tmUtc);
+    server.sendHeader("Last-Modified", lastModified);
+  }
+  server.sendHeader("Accept-Ranges", "bytes");
+
+  if (validTime && server.hasHeader("If-Modified-Since")) {
+    time_t since = parseHttpDate(server.header("If-Modified-Since"));
+    if (since > 0 && mtime <= since) {
+      server.send(304);
+      return;
+    }
+  }
+
+  size_t start = 0;
+  size_t end = size > 0 ? size - 1 : 0;
+  bool partial = false;
+
+  // Single ranges only; multi-range requests get the full body (RFC 7233)
+  String range = server.hasHeader("Range") ? server.header("Range") : "";
+  if (range.startsWith("bytes=") && range.indexOf(',') == -1) {
+    int dash = range.indexOf('-');
+    String first = range.substring(6, dash);
+    String last = range.substring(dash + 1);
+    first.trim();
+    last.trim();
+
+    if (dash > 0 && (first.length() > 0 || last.length() > 0)) {
+      if (first.length() == 0) {
+        // Suffix range: last N bytes
+        size_t n = (size_t)last.toInt();
+        start = n < size ? size - n : 0;
+      } else {
+        start = (size_t)first.toInt();
+        if (last.length() > 0 && (size_t)last.toInt() < end) end = (size_t)last.toInt();
+      }
+
+      if (start >= size || start > end) {
+        server.sendHeader("Content-Range", "bytes */" + String(size));
+        server.send(416, "text/plain", "Range Not Satisfiable");
+        return;
+      }
+      partial = true;
+      server.sendHeader("Content-Range", "bytes " + String(start) + "-" + String(end) + "/" + String(size));
+    }
+  }
+
+  size_t remaining = size > 0 ? end - start + 1 : 0;
+  server.setContentLength(remaining);
+  server.send(partial ? 206 : 200, contentType, "");
+
+  if (start > 0) file.seek(start);
+  uint8_t buffer[1024];
+  WiFiClient client = server.client();
+  while (remaining > 0 && client.connected()) {
+    size_t n = file.read(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+    if (n == 0) break;
+    client.write(buffer, n);
+    remaining -= n;
+  }
+}
+
 void handleGetSdLogs() {
   if (!isAuthenticated()) {
     server.send(401);
     return;
   }
-  server.send(200, "text/plain", settingsManager.getSdLogs());
+  File file = settingsManager.openSdLogs();
+  if (!file) {
+    // No log yet: keep returning an empty body like before
+    server.send(200, "text/plain", "");
+    return;
+  }
+  streamLogFile(file, "text/plain");
+  file.close();
+}
+
+// UI render/flush histograms plus the log writer's append/commit timings;
+// ?overlay=1|0 toggles the on-screen overlay
+void handleApiPerf() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  if (server.hasArg("overlay")) display.setPerfOverlay(server.arg("overlay") == "1");
+
+  const LogWriter::Stats &log = settingsManager.getLogStats();
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           ",\"log\":{\"records\":%u,\"commits\":%u,\"appendUsAvg\":%u,\"appendUsMax\":%u,"
+           "\"commitUsAvg\":%u,\"commitUsMax\":%u,\"pending\":%u,\"recovered\":%u,\"dropped\":%u}}",
+           log.records, log.commits, log.records ? log.appendUsTotal / log.records : 0, log.appendUsMax,
+           log.commits ? log.commitUsTotal / log.commits : 0, log.commitUsMax, settingsManager.getLogPending(),
+           log.recovered, log.dropped);
+  String json = display.getPerfJson();
+  json.remove(json.length() - 1); // Reopen the object for "log"
+  json += buf;
+  server.send(200, "application/json", json);
+}
+
+#if UI_TEST_HOOKS
+// PNG of what is on the panel now, for golden-image checks (ui_regress.py)
+void handleApiUiScreenshot() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  if (!display.captureScreen()) {
+    server.send(503, "application/json", "{\"status\":\"error\", \"message\":\"Capture failed\"}");
+    return;
+  }
+  server.sendHeader("Cache-Control", "no-store");
+  server.setContentLength(PngEncoder::encodedSize(DISPLAY_WIDTH, DISPLAY_HEIGHT));
+  server.send(200, "image/png", "");
+  WiFiClient client = server.client();
+  if (!display.writeCapturePng(client)) {
+    Serial.println("UI: Screenshot transfer aborted");
+  }
+  display.releaseCapture();
+}
+
+// Scripted tap: ?x=&y=[&ms=] in screen coordinates (480x320)
+void handleApiUiTouch() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  int ms = server.hasArg("ms") ? server.arg("ms").toInt() : 100;
+  if (!server.hasArg("x") || !server.hasArg("y") ||
+      !display.injectTouch(server.arg("x").toInt(), server.arg("y").toInt(), constrain(ms, 0, 5000))) {
+    server.send(400, "application/json", "{\"status\":\"error\", \"message\":\"Bad coordinates or tap pending\"}");
+    return;
+  }
+  server.send(200, "application/json", "{\"status\":\"ok\"}");
+}
+#endif
+
+// Arena usage, high-water marks and heap fragmentation
+void handleApiMem() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  server.send(200, "application/json", memoryManager.toJson());
+}
+
+// Voice prompt cache; ?forget=NAME drops a prompt so it is downloaded again
+void handleApiSounds() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  if (server.hasArg("forget")) {
+    int p = SoundManager::findPrompt(server.arg("forget"));
+    if (p < 0) {
+      server.send(400, "application/json", "{\"status\":\"error\", \"message\":\"Unknown prompt\"}");
+      return;
+    }
+    soundManager.forget((SoundPrompt)p);
+  }
+  server.send(200, "application/json", soundManager.toJson());
+}
+
+// POST /api/sounds?name=NAME with an MP3 to replace a prompt (e.g. a recorded voice)
+File soundUploadFile;
+int soundUploadPrompt = -1;
+
+void handleUploadSound() {
+  if (!isAuthenticated()) { server.send(401); return; }
+
+  HTTPUpload& upload = server.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    soundUploadPrompt = SoundManager::findPrompt(server.arg("name"));
+    LittleFS.remove(SOUND_TMP);
+    if (soundUploadPrompt >= 0) soundUploadFile = LittleFS.open(SOUND_TMP, "w");
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (soundUploadFile && soundUploadFile.write(upload.buf, upload.currentSize) != upload.currentSize) {
+      soundUploadFile.close();
+      LittleFS.remove(SOUND_TMP);
+    }
+  } else if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED) {
+    bool ok = soundUploadFile && upload.status == UPLOAD_FILE_END && upload.totalSize > 0;
+    if (soundUploadFile) soundUploadFile.close();
+    ok = ok && soundManager.install((SoundPrompt)soundUploadPrompt);
+    if (!ok) {
+      LittleFS.remove(SOUND_TMP);
+      soundUploadPrompt = -1;
+    }
+    Serial.printf("Sound upload %s: %s (%u bytes)\n", ok ? "OK" : "FAILED", server.arg("name").c_str(), upload.totalSize);
+  }
+}
+
+void handleUploadSoundDone() {
+  if (!isAuthenticated()) { server.send(401); return; }
+  if (soundUploadPrompt < 0 || !soundManager.isCached((SoundPrompt)soundUploadPrompt)) {
+    server.send(400, "application/json", "{\"status\":\"error\", \"message\":\"Unknown prompt or write failed\"}");
+    return;
+  }
+  soundUploadPrompt = -1;
+  server.send(200, "application/json", soundManager.toJson());
+}
+
+// Ad frame cache hit rate and PSRAM usage
+void handleApiAdCache() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  server.send(200, "application/json", display.getAdCacheJson());
+}
+
+// Live counters kept by SalesStats; constant cost regardless of log size
+void handleApiStats() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  server.send(200, "application/json", salesStats.toJson());
+}
+
+// Daily totals from the archive index: /api/history?from=YYYYMMDD&to=YYYYMMDD
+void handleApiHistory() {
+  if (!isAuthenticated()) {
+    server.send(401, "application/json", "{\"status\":\"error\", \"message\":\"Unauthorized\"}");
+    return;
+  }
+  uint32_t from = server.hasArg("from") ? server.arg("from").toInt() : 0;
+  uint32_t to = server.hasArg("to") ? server.arg("to").toInt() : 99999999;
+  server.send(200, "application/json", settingsManager.getHistoryJson(from, to));
+}
+
+// Raw compressed segment for one sealed day (decode with decode_archive.py)
+void handleGetArchive() {
+  if (!isAuthenticated()) {
+    server.send(401);
+    return;
+  }
+  File file = settingsManager.openArchive(server.arg("day").toInt());
+  if (!file) {
+    server.send(404, "text/plain", "Archive not found");
+    return;
+  }
+  server.sendHeader("Content-Disposition", "attachment; filename=\"" + server.arg("day") + ".seg\"");
+  streamLogFile(file, "application/octet-stream");
+  file.close();
 }
 
 void handleClearSdLogs() {
@@ -1022,6 +1309,161 @@ void handleDeleteAd() {
   }
 }
 
+// Small BMP preview for the admin list. The page adds &v=<mtime>, so the
+// response can be cached forever; a re-upload changes the URL.
+void handleAdThumb() {
+  if (!isAuthenticated()) { server.send(401); return; }
+  String name = server.arg("name");
+  if (name == "" || name.indexOf('/') >= 0 || name.indexOf("..") >= 0) {
+    server.send(400, "text/plain", "Bad name");
+    return;
+  }
+
+  File file = SD.open(AdManifest::thumbnailPath(name), FILE_READ);
+  if (!file) {
+    // Ads uploaded before thumbnails existed: build it for the next load
+    if (settingsManager.adManifest.indexOf(name) >= 0) display.requestAdThumbnail(name);
+    server.send(404, "text/plain", "No thumbnail");
+    return;
+  }
+  server.sendHeader("Cache-Control", "private, max-age=31536000, immutable");
+  server.streamFile(file, "image/bmp");
+  file.close();
+}
+
+// Ad upload state. One handle stays open for the whole upload; chunks are
+// coalesced into AD_UPLOAD_BUFFER (a multiple of the 512-byte sector) so
+// the card sees a few large aligned writes instead of an open/append/close
+// per chunk. Data goes to a temp file renamed over the ad on success, so
+// a failed upload never leaves a truncated ad in /ads.
+#define AD_UPLOAD_BUFFER (16 * 1024)
+#define AD_UPLOAD_TMP "/.ad_upload.tmp"
+#define AD_UPLOAD_OLD "/.ad_upload.old" // Replaced ad, kept until the new one is in place
+
+struct AdUpload {
+  File file;
+  uint8_t *buf = nullptr;
+  size_t fill = 0;
+  size_t written = 0;
+  size_t limit = 0;       // Bytes left under the quota
+  unsigned long startedAt = 0;
+  String name;
+  String error;           // Set when the upload is being discarded
+  bool overQuota = false; // error is the quota (413), not an I/O failure (500)
+
+  void begin(const String &filename, size_t contentLength) {
+    abort();
+    name = filename;
+    error = "";
+    overQuota = false;
+    startedAt = millis();
+
+    uint64_t used = settingsManager.adManifest.quotaBytes();
+    int existing = settingsManager.adManifest.indexOf(filename);
+    if (existing >= 0) used -= settingsManager.adManifest.at(existing).size; // Replaced, keeps its thumbnail slot
+    else used += AD_THUMB_MAX_BYTES;                                         // The new ad's thumbnail
+    limit = used < ADS_QUOTA_BYTES ? ADS_QUOTA_BYTES - used : 0;
+    // Content-Length covers the whole multipart body, an upper bound
+    if (contentLength > limit + 1024) {
+      error = "Espacio insuficiente (cuota de anuncios)";
+      overQuota = true;
+      Serial.printf("Upload Rejected: %s needs %u bytes, %u free\n", filename.c_str(), contentLength, limit);
+      return;
+    }
+
+    buf = (uint8_t *)memoryManager.alloc(MEM_UPLOAD, AD_UPLOAD_BUFFER);
+    SD.remove(AD_UPLOAD_TMP);
+    file = SD.open(AD_UPLOAD_TMP, FILE_WRITE);
+    if (!buf || !file) {
+      error = "No se pudo crear el archivo";
+      abort();
+      return;
+    }
+    Serial.println("Upload Start: /ads/" + filename);
+  }
+
+  bool flush() {
+    if (fill == 0) return true;
+    bool ok = file.write(buf, fill) == fill;
+    fill = 0;
+    return ok;
+  }
+
+  void write(const uint8_t *data, size_t len) {
+    if (error.length() || !file) return;
+    if (written + fill + len > limit) {
+      error = "Espacio insuficiente (cuota de anuncios)";
+      overQuota = true;
+      abort();
+      return;
+    }
+    while (len > 0) {
+      size_t n = min(len, (size_t)AD_UPLOAD_BUFFER - fill);
+      memcpy(buf + fill, data, n);
+      fill += n;
+      data += n;
+      len -= n;
+      if (fill == AD_UPLOAD_BUFFER) {
+        written += fill;
+        if (!flush()) {
+          error = "Error de escritura en SD";
+          abort();
+          return;
+        }
+      }
+    }
+  }
+
+  bool finish() {
+    if (error.length() || !file) {
+      if (!error.length()) error = "Error de escritura en SD";
+      abort();
+      return false;
+    }
+    written += fill;
+    bool ok = flush();
+    file.close();
+    memoryManager.free(MEM_UPLOAD, buf);
+    buf = nullptr;
+
+    String path = "/ads/" + name;
+    if (ok) {
+      // Move the old ad aside rather than deleting it, so a failed rename
+      // leaves it where it was
+      bool replacing = SD.exists(path);
+      SD.remove(AD_UPLOAD_OLD);
+      ok = !replacing || SD.rename(path, AD_UPLOAD_OLD);
+      if (ok) ok = SD.rename(AD_UPLOAD_TMP, path);
+      if (replacing) {
+        if (ok) SD.remove(AD_UPLOAD_OLD);
+        else if (!SD.exists(path)) SD.rename(AD_UPLOAD_OLD, path);
+      }
+    }
+    if (!ok) {
+      error = "Error de escritura en SD";
+      SD.remove(AD_UPLOAD_TMP);
+      return false;
+    }
+
+    unsigned long elapsed = millis() - startedAt;
+    Serial.printf("Upload Success: %s (%u bytes) in %lu ms, %.1f KB/s\n", name.c_str(), written, elapsed,
+                  elapsed ? written / 1.024f / elapsed : 0.0f);
+    return true;
+  }
+
+  void abort() {
+    if (file) {
+      file.close();
+      SD.remove(AD_UPLOAD_TMP);
+    }
+    memoryManager.free(MEM_UPLOAD, buf);
+    buf = nullptr;
+    fill = 0;
+    written = 0;
+  }
+};
+AdUpload adUpload;
+
 void handleUploadAd() {
   if (!isAuthenticated()) { server.send(401); return; }
   
@@ -1043,33 +1485,27 @@ void handleUploadAd() {
   }
 
   if (upload.status == UPLOAD_FILE_START) {
-    // Check storage limit ONLY at start
-    if (settingsManager.getDirSize("/ads") > 419430400) {
-      Serial.println("Upload Error: Quota exceeded");
-      // We can't easily stop the stream here without closing connection
-      return;
-    }
-
-    String filename = "/ads/" + upload.filename;
-    Serial.println("Upload Start: " + filename);
-    
-    // Create or truncate the file
-    File file = SD.open(filename, FILE_WRITE);
-    if (!file) {
-        Serial.println("Failed to create file: " + filename);
-    } else {
-        file.close(); 
-    }
+    adUpload.begin(upload.filename, server.clientContentLength());
   } else if (upload.status == UPLOAD_FILE_WRITE) {
-    // Check if file was created successfully before
-    String filename = "/ads/" + upload.filename;
-    File file = SD.open(filename, FILE_APPEND);
-    if (file) {
-      file.write(upload.buf, upload.currentSize);
-      file.close();
-    }
+    adUpload.write(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    adUpload.abort();
+    Serial.println("Upload Aborted: " + upload.filename);
   } else if (upload.status == UPLOAD_FILE_END) {
-    Serial.println("Upload Success: " + upload.filename + " (" + String(upload.totalSize) + " bytes)");
+    if (!adUpload.finish()) {
+      String msg = adUpload.error;
+      int code = adUpload.overQuota ? 413 : 500; // Quota vs SD write/rename
+      if (server.hasArg("api")) {
+        server.send(code, "application/json", "{\"status\":\"error\", \"message\":\"" + msg + "\"}");
+      } else {
+        String html = "<html><head><meta http-equiv='refresh' content='3;url=/admin'></head>";
+        html += "<body><h3>Error: " + msg + "</h3><p>Volviendo...</p></body></html>";
+        server.send(code, "text/html", html);
+      }
+      return;
+    }
+    settingsManager.adManifest.onFileWritten(upload.filename);
+    display.requestAdThumbnail(upload.filename); // Built in the background
     
     // Check if client wants JSON (Simple check: if header "X-Response-Type" is "json" or query param)
     // For simplicity, we can default to JSON if query param ?type=json is present, OR just return JSON if it looks like an API call.
@@ -1097,17 +1533,15 @@ void handleCreatePayment() {
       units = settingsManager.fixedUnits;
   }
 
+  // --- PRICING (same rules as the TFT; no promo in fixed mode) ---
+  PriceQuote quote = currentPriceRules().quote(units);
   currentUnits = units;
-  currentAmount = units * settingsManager.pricePerUnit;
+  currentAmount = PriceRules::toPesos(quote.totalCentavos);
   currentExternalRef = "ESP32_" + String(millis());
   paymentConfirmed = false;
-
-  // --- PROMOTION LOGIC (Backend Match) ---
-  if (settingsManager.promoEnabled && units >= settingsManager.promoThreshold) {
-      Serial.println("Promotion Triggered (Web)! Applying discount...");
-      float discountFactor = (100.0 - settingsManager.promoValue) / 100.0;
-      currentAmount = currentAmount * discountFactor;
-  }
+  currentPromoApplied = quote.promoApplied;
+  currentFromQr = false;
+  if (quote.promoApplied) Serial.println("Promotion Triggered (Web)! Applying discount...");
 
   String unitLabel;
   if (settingsManager.operationMode == 0) {
@@ -1127,7 +1561,11 @@ void handleCreatePayment() {
                  " Amt=" + String(currentAmount) + " URL=" + initPoint);
 
   // Show QR on Display (Optional mirror)
-  display.showQR(initPoint, currentAmount);
+  display.showQR(initPoint.c_str(), currentAmount);
+  if (initPoint != "Error" && initPoint != "") {
+    salesStats.recordQr();
+    currentFromQr = true;
+  }
 
   server.send(200, "application/json", "{\"url\":\"" + initPoint + "\"}");
 }
@@ -1197,7 +1635,7 @@ void handleTestRelay() {
     pulseActive = false;
     nextPulseAction = millis();
     Serial.println("TEST Mode (Pulse): " + String(val) + " pulses");
-    settingsManager.addLog(0, val, "TEST_PULSE");
+    settingsManager.addLog(0, val, "TEST_PULSE", 1);
     server.send(200, "text/plain",
                 "Pulse test started (" + String(val) + " pulses)");
   } else {
@@ -1384,6 +1822,7 @@ void setup() {
 
   settingsManager.begin();
   settingsManager.loadSettings(payments, NUM_PAYMENTS);
+  salesStats.begin(TZ_OFFSET_SEC);
 
   // Use loaded credentials or fall back to defaults from config.h
   if (settingsManager.mpAccessToken.length() < 10) {
@@ -1404,20 +1843,21 @@ void setup() {
   display.begin();       // Init Display first so labels are created
   soundManager.begin();  // Init Audio
   display.setSoundManager(&soundManager); // Link audio to display
+  display.setAdManifest(&settingsManager.adManifest);
 
   display.setPricePerUnit(settingsManager.pricePerUnit);
   display.setOperationMode(settingsManager.operationMode);
   // Pass Initial Promo Config
   display.setPromoConfig(settingsManager.promoEnabled, settingsManager.promoThreshold, settingsManager.promoType, settingsManager.promoValue);
   display.setFixedModeConfig(settingsManager.fixedUnits);
-  display.setStaticQrText(settingsManager.staticQrText);
+  display.setStaticQrText(settingsManager.staticQrText.c_str());
   
   display.setPaymentCallback(onTftPaymentRequest);
   display.setActivationCallback(onServiceActivation); // Register activation callback
   display.setCancelCallback(onPaymentCancel); // Register cancellation callback
   
-  String sdMsg = settingsManager.isSdAvailable() ? "SD OK" : "SD ERROR";
-  display.showStartup("Buscando WiFi...\n" + sdMsg); // Show Splash with SD Status
+  // Show Splash with SD Status
+  display.showStartup(settingsManager.isSdAvailable() ? "Buscando WiFi...\nSD OK" : "Buscando WiFi...\nSD ERROR");
   delay(2000);
 
   pinMode(PIN_LED, OUTPUT);
@@ -1445,6 +1885,7 @@ void setup() {
   server.on("/save_credentials", HTTP_POST, handleSaveCredentials);
   server.on("/exit_ap", handleExitAP);
   server.on("/list_ads", handleListAds);
+  server.on("/ad_thumb", handleAdThumb);
   server.on("/delete_ad", handleDeleteAd);
   server.on("/upload_ad", HTTP_POST, [](){}, handleUploadAd);
   server.on("/create_payment", handleCreatePayment);
@@ -1453,6 +1894,7 @@ void setup() {
   server.on("/clear_logs", handleClearLogs);
   server.on("/get_sd_logs", handleGetSdLogs);
   server.on("/clear_sd_logs", handleClearSdLogs);
+  server.on("/get_archive", handleGetArchive);
   server.on("/scan_wifi", handleScanWifi);
   server.on("/test_relay", handleTestRelay);
   server.on("/check_update", handleCheckUpdate);
@@ -1463,6 +1905,17 @@ void setup() {
   server.on("/api/get_settings", handleApiGetSettings);
   server.on("/api/save_settings", HTTP_POST, handleApiSaveSettings);
   server.on("/api/get_logs", handleApiGetLogs);
+  server.on("/api/history", handleApiHistory);
+  server.on("/api/stats", handleApiStats);
+  server.on("/api/ad_cache", handleApiAdCache);
+  server.on("/api/mem", handleApiMem);
+  server.on("/api/perf", handleApiPerf);
+#if UI_TEST_HOOKS
+  server.on("/api/ui/screenshot", handleApiUiScreenshot);
+  server.on("/api/ui/touch", handleApiUiTouch);
+#endif
+  server.on("/api/sounds", HTTP_GET, handleApiSounds);
+  server.on("/api/sounds", HTTP_POST, handleUploadSoundDone, handleUploadSound);
   server.on("/api/scan_wifi", handleApiScanWifi);
   server.on("/api/test_relay", handleApiTestRelay);
   
@@ -1471,7 +1924,7 @@ void setup() {
   server.on("/api/delete_ad", handleDeleteAd);
   server.on("/api/upload_ad", HTTP_POST, [](){}, handleUploadAd);
 
-  const char *headerkeys[] = {"Cookie", "Authorization"};
+  const char *headerkeys[] = {"Cookie", "Authorization", "Range", "If-Modified-Since"};
   size_t headerkeyssize = sizeof(headerkeys) / sizeof(char *);
   server.collectHeaders(headerkeys, headerkeyssize);
 
@@ -1631,7 +2084,7 @@ void handleApiSaveSettings() {
   display.setOperationMode(settingsManager.operationMode);
   display.setPromoConfig(settingsManager.promoEnabled, settingsManager.promoThreshold, settingsManager.promoType, settingsManager.promoValue);
   display.setFixedModeConfig(settingsManager.fixedUnits);
-  display.setStaticQrText(settingsManager.staticQrText);
+  display.setStaticQrText(settingsManager.staticQrText.c_str());
   
   // Sync Live Objects
   mpClient.setAccessToken(settingsManager.mpAccessToken);
@@ -1661,12 +2114,18 @@ void handleApiGetLogs() {
           int c1 = line.indexOf(',');
           int c2 = line.indexOf(',', c1 + 1);
           if (c1 > 0 && c2 > 0) {
+              // amount,duration,ref[,ts,mode] - older rows lack the last two
+              int c3 = line.indexOf(',', c2 + 1);
+              int c4 = c3 > 0 ? line.indexOf(',', c3 + 1) : -1;
               String amt = line.substring(0, c1);
               String dur = line.substring(c1 + 1, c2);
-              String ref = line.substring(c2 + 1);
+              String ref = c3 > 0 ? line.substring(c2 + 1, c3) : line.substring(c2 + 1);
+              String ts = c3 > 0 ? line.substring(c3 + 1, c4 > 0 ? c4 : line.length()) : "0";
+              String mode = c4 > 0 ? line.substring(c4 + 1) : "T";
               
               if(!first) json += ",";
-              json += "{\"amount\":" + amt + ", \"duration\":" + dur + ", \"ref\":\"" + ref + "\"}";
+              json += "{\"amount\":" + amt + ", \"duration\":" + dur + ", \"ref\":\"" + ref +
+                      "\", \"ts\":" + ts + ", \"mode\":\"" + mode + "\"}";
               first = false;
           }
       }
@@ -1730,7 +2189,7 @@ void handleApiTestRelay() {
     pulsesToOutput = val;
     pulseActive = false;
     nextPulseAction = millis();
-    settingsManager.addLog(0, val, "TEST_PULSE_APP");
+    settingsManager.addLog(0, val, "TEST_PULSE_APP", 1);
     server.send(200, "application/json", "{\"status\":\"ok\", \"message\":\"Pulse test started\"}");
   } else {
     server.send(400, "application/json", "{\"status\":\"error\", \"message\":\"Invalid Mode\"}");
@@ -1818,6 +2277,8 @@ void loop() {
     }
   }
 
+  settingsManager.loop();
+  salesStats.loop();
   soundManager.loop(); 
   display.loop();
   delay(1);
@@ -0,0 +1,84 @@
+// Keypad total recalculation, old float/sprintf path vs PriceRules:
+//   g++ -std=c++11 -O2 -I.. pricing_bench.cpp -o pricing_bench && ./pricing_bench
+// Each key appends a digit (up to six, like the keypad), then the total and
+// promo note are rebuilt as updateKeypadTotal() does, minus the LVGL calls.
+
+#include "Pricing.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+static const int SEQUENCES = 200000;
+static const int MAX_DIGITS = 6;
+
+struct Settings {
+  float pricePerUnit;
+  bool promoEnabled;
+  int promoThreshold;
+  float promoValue;
+};
+
+static char digits[SEQUENCES][MAX_DIGITS];
+static unsigned sink = 0; // Keeps the formatted text alive
+
+static void makeSequences() {
+  uint32_t seed = 12345;
+  for (int s = 0; s < SEQUENCES; s++) {
+    for (int d = 0; d < MAX_DIGITS; d++) {
+      seed = seed * 1664525u + 1013904223u;
+      digits[s][d] = '0' + (seed >> 24) % 10;
+    }
+  }
+}
+
+// What event_handler_num did before Pricing.h
+static void legacyKey(const Settings &st, const char *typed) {
+  int amount = atoi(typed);
+  float total = amount * st.pricePerUnit;
+  char pBuf[32] = "";
+  if (st.promoEnabled && amount >= st.promoThreshold) {
+    float discountFactor = (100.0 - st.promoValue) / 100.0;
+    total = total * discountFactor;
+    sprintf(pBuf, "Desc. %.0f%% Aplicado!", st.promoValue);
+  }
+  char buf[32];
+  sprintf(buf, "Total: $%.2f", total);
+  sink += buf[8] + pBuf[0];
+}
+
+static void rulesKey(const PriceRules &rules, const char *typed) {
+  PriceQuote q = rules.quote(atoi(typed));
+  char pBuf[32] = "";
+  if (q.promoApplied) snprintf(pBuf, sizeof(pBuf), "Desc. %d%% Aplicado!", (int)((rules.discountBasisPoints() + 50) / 100));
+  char buf[32] = "Total: $";
+  PriceRules::format(buf + 8, sizeof(buf) - 8, q.totalCentavos);
+  sink += buf[8] + pBuf[0];
+}
+
+template <typename F> static double nsPerKey(F key) {
+  char typed[MAX_DIGITS + 1];
+  auto t0 = std::chrono::steady_clock::now();
+  for (int s = 0; s < SEQUENCES; s++) {
+    for (int d = 0; d < MAX_DIGITS; d++) {
+      typed[d] = digits[s][d];
+      typed[d + 1] = '\0';
+      key(typed);
+    }
+  }
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+  return (double)ns / (SEQUENCES * MAX_DIGITS);
+}
+
+int main() {
+  makeSequences();
+  Settings st = {12.5f, true, 10, 15.0f};
+  PriceRules rules = PriceRules::fromSettings(st.pricePerUnit, 0, st.promoEnabled, st.promoThreshold, st.promoValue);
+
+  nsPerKey([&](const char *t) { rulesKey(rules, t); }); // Warm up
+  double legacy = nsPerKey([&](const char *t) { legacyKey(st, t); });
+  double fixed = nsPerKey([&](const char *t) { rulesKey(rules, t); });
+  printf("%d keys: float+sprintf %.1f ns/key, PriceRules %.1f ns/key (%.2fx)\n", SEQUENCES * MAX_DIGITS, legacy, fixed,
+         legacy / fixed);
+  return sink == 0; // Never true; stops the work being optimized out
+}
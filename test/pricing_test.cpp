@@ -0,0 +1,98 @@
+// Host tests for Pricing.h (header-only, no Arduino needed):
+//   g++ -std=c++11 -O2 -Wall -I.. pricing_test.cpp -o pricing_test && ./pricing_test
+// Lives outside the sketch folder's root so the Arduino build ignores it.
+
+#include "Pricing.h"
+
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected)                                                                      \
+  do {                                                                                                  \
+    long long a_ = (long long)(actual), e_ = (long long)(expected);                                      \
+    if (a_ != e_) {                                                                                     \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_);                  \
+      failures++;                                                                                       \
+    }                                                                                                   \
+  } while (0)
+
+static void testThreshold() {
+  PriceRules r = PriceRules::fromSettings(10.0f, 0, true, 5, 10.0f);
+  CHECK_EQ(r.quote(4).promoApplied, false);
+  CHECK_EQ(r.quote(4).totalCentavos, 4000);
+  CHECK_EQ(r.quote(5).promoApplied, true);
+  CHECK_EQ(r.quote(5).totalCentavos, 4500);
+  CHECK_EQ(r.promoApplies(5), true);
+  CHECK_EQ(r.quote(0).totalCentavos, 0);
+
+  PriceRules disabled = PriceRules::fromSettings(10.0f, 0, false, 5, 10.0f);
+  CHECK_EQ(disabled.quote(50).promoApplied, false);
+  CHECK_EQ(disabled.quote(50).totalCentavos, 50000);
+
+  PriceRules fromOne = PriceRules::fromSettings(10.0f, 1, true, 1, 10.0f);
+  CHECK_EQ(fromOne.quote(1).totalCentavos, 900);
+}
+
+static void testRounding() {
+  CHECK_EQ(PriceRules::toCentavos(19.99f), 1999);
+  CHECK_EQ(PriceRules::toCentavos(0.29f), 29);
+  CHECK_EQ(PriceRules::toCentavos(-2.5f), -250);
+  CHECK_EQ(PriceRules::toBasisPoints(12.5f), 1250);
+
+  // 3 x 3.33 = 9.99, 12.5 % off = 8.74125
+  CHECK_EQ(PriceRules::fromSettings(3.33f, 0, true, 1, 12.5f).quote(3).totalCentavos, 874);
+  // 0.01 x 50 % = 0.005, half a centavo rounds up
+  CHECK_EQ(PriceRules(1, 1, 5000).quote(1).totalCentavos, 1);
+  // 0.03 x 3 x 50 % = 0.045
+  CHECK_EQ(PriceRules(3, 1, 5000).quote(3).totalCentavos, 5);
+
+  char buf[32];
+  PriceRules::format(buf, sizeof(buf), 123450);
+  CHECK_EQ(strcmp(buf, "1234.50"), 0);
+  PriceRules::format(buf, sizeof(buf), 5);
+  CHECK_EQ(strcmp(buf, "0.05"), 0);
+  PriceRules::format(buf, sizeof(buf), -150);
+  CHECK_EQ(strcmp(buf, "-1.50"), 0);
+}
+
+static void testFixedMode() {
+  PriceRules r = PriceRules::fromSettings(10.0f, 2, true, 1, 50.0f);
+  CHECK_EQ(r.quote(3).promoApplied, false);
+  CHECK_EQ(r.quote(3).totalCentavos, 3000);
+  CHECK_EQ(r.discountBasisPoints(), 5000); // Still reported, never applied
+}
+
+static void testZeroPercent() {
+  PriceRules r = PriceRules::fromSettings(10.0f, 0, true, 0, 0.0f);
+  CHECK_EQ(r.quote(3).promoApplied, false);
+  CHECK_EQ(r.quote(3).totalCentavos, 3000);
+  // Out-of-range percentages are clamped
+  CHECK_EQ(PriceRules::fromSettings(10.0f, 0, true, 1, -5.0f).quote(3).totalCentavos, 3000);
+  CHECK_EQ(PriceRules::fromSettings(10.0f, 0, true, 1, 150.0f).quote(3).totalCentavos, 0);
+}
+
+static void testOverflow() {
+  // Six keypad digits at the largest unit price a setting can hold
+  CHECK_EQ(PriceRules(INT32_MAX, PriceRules::NO_PROMO, 0).quote(999999).totalCentavos, 999999LL * INT32_MAX);
+  CHECK_EQ(PriceRules(INT32_MAX, 1, 1000).quote(999999).totalCentavos, 1932733349564718LL);
+  CHECK_EQ(PriceRules(INT32_MAX, 1, 1).quote(INT32_MAX).promoApplied, true);
+  // Web requests are not limited to six digits
+  CHECK_EQ(PriceRules(INT32_MAX, 1, 0).quote(INT32_MAX).totalCentavos, 4611686014132420609LL);
+  CHECK_EQ(PriceRules(INT32_MAX, 1, 5000).quote(INT32_MAX).totalCentavos, 2305843007066210305LL);
+  CHECK_EQ(PriceRules::fromSettings(1000.0f, 0, true, 1, 10.0f).quote(999999).totalCentavos, 89999910000LL);
+}
+
+int main() {
+  testThreshold();
+  testRounding();
+  testFixedMode();
+  testZeroPercent();
+  testOverflow();
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("pricing: all checks passed\n");
+  return 0;
+}
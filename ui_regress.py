@@ -0,0 +1,121 @@
+import argparse
+import http.cookiejar
+import io
+import json
+import os
+import sys
+import time
+import urllib.request
+
+from PIL import Image, ImageChops
+
+# UI regression run against a device on the network. Plays a script of
+# taps through /api/ui/touch, grabs PNG screenshots from /api/ui/screenshot
+# and compares them with golden images, then checks the screen transition
+# and QR timings from /api/perf. The firmware must be built with
+# UI_TEST_HOOKS=1; production builds do not have those endpoints.
+#   python ui_regress.py 192.168.1.50 ui_script.txt --golden golden/
+#   python ui_regress.py 192.168.1.50 ui_script.txt --golden golden/ --update
+#
+# Test build:
+#   arduino-cli compile --fqbn esp32:esp32:esp32s3:PSRAM=opi \
+#     --build-property "compiler.cpp.extra_flags=-DUI_TEST_HOOKS=1"
+# Each screenshot freezes the UI (up to 5 s) while the PNG is sent.
+#
+# Script, one step per line ('#' comments):
+#   tap X Y [MS]   press at screen coordinates (480x320) for MS (default 100)
+#   wait MS        let the UI settle
+#   shot NAME      screenshot, compared with / saved as NAME.png
+
+
+class Device:
+    def __init__(self, host, user, password):
+        self.base = "http://" + host
+        self.opener = urllib.request.build_opener(
+            urllib.request.HTTPCookieProcessor(http.cookiejar.CookieJar()))
+        body = json.dumps({"user": user, "pass": password}).encode()
+        req = urllib.request.Request(self.base + "/api/login", body, {"Content-Type": "application/json"})
+        self.opener.open(req, timeout=10).read()
+
+    def get(self, path):
+        return self.opener.open(self.base + path, timeout=30).read()
+
+
+def compare(shot, golden, tolerance):
+    # Pixels whose channels differ by more than `tolerance` (RGB565 rounding
+    # aside, antialiasing should be bit exact between runs)
+    diff = ImageChops.difference(shot.convert("RGB"), golden.convert("RGB"))
+    mask = diff.point(lambda v: 255 if v > tolerance else 0).convert("L")
+    return sum(1 for v in mask.getdata() if v), diff
+
+
+def run(args):
+    dev = Device(args.host, args.user, args.password)
+    os.makedirs(args.golden, exist_ok=True)
+    failures = 0
+
+    with open(args.script) as f:
+        steps = [line.split() for line in f if line.strip() and not line.lstrip().startswith("#")]
+
+    for step in steps:
+        cmd = step[0]
+        if cmd == "tap":
+            ms = int(step[3]) if len(step) > 3 else 100
+            dev.get("/api/ui/touch?x=%s&y=%s&ms=%d" % (step[1], step[2], ms))
+            time.sleep(ms / 1000 + 0.05)
+        elif cmd == "wait":
+            time.sleep(int(step[1]) / 1000)
+        elif cmd == "shot":
+            name = step[1]
+            shot = Image.open(io.BytesIO(dev.get("/api/ui/screenshot")))
+            path = os.path.join(args.golden, name + ".png")
+            if args.update or not os.path.exists(path):
+                shot.save(path)
+                print("%-20s saved" % name)
+                continue
+            bad, diff = compare(shot, Image.open(path), args.tolerance)
+            if bad > args.max_pixels:
+                failures += 1
+                shot.save(os.path.join(args.golden, name + ".actual.png"))
+                diff.save(os.path.join(args.golden, name + ".diff.png"))
+                print("%-20s FAIL (%d pixels differ)" % (name, bad))
+            else:
+                print("%-20s ok (%d pixels differ)" % (name, bad))
+        else:
+            sys.exit("Unknown step: %s" % " ".join(step))
+
+    perf = json.loads(dev.get("/api/perf"))
+    for key, limit in (("transitionUs", args.max_transition_ms), ("qrUs", args.max_qr_ms)):
+        h = perf[key]
+        if not h["count"]:
+            continue
+        print("%-20s n=%d p50=%.1f ms p95=%.1f ms max=%.1f ms" %
+              (key, h["count"], h["p50"] / 1000, h["p95"] / 1000, h["max"] / 1000))
+        if limit and h["p95"] / 1000 > limit:
+            failures += 1
+            print("%-20s FAIL (p95 over %d ms)" % (key, limit))
+
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Screenshot and timing regression for the device UI")
+    parser.add_argument("host", help="Device address")
+    parser.add_argument("script", help="Step file (tap/wait/shot)")
+    parser.add_argument("--golden", default="ui_golden", help="Golden image directory")
+    parser.add_argument("--update", action="store_true", help="Overwrite golden images")
+    parser.add_argument("--user", default="admin")
+    parser.add_argument("--password", default="admin")
+    parser.add_argument("--tolerance", type=int, default=8, help="Per-channel difference ignored")
+    parser.add_argument("--max-pixels", type=int, default=0, help="Differing pixels allowed per shot")
+    parser.add_argument("--max-transition-ms", type=int, default=0, help="Fail if transition p95 exceeds this")
+    parser.add_argument("--max-qr-ms", type=int, default=0, help="Fail if showQR p95 exceeds this")
+    args = parser.parse_args()
+
+    failures = run(args)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()